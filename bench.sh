@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+
+# Times every test program with the release build. Set BIN to compare
+# another binary, DIR to time other programs and RUNS to change how many
+# times each program runs.
+
+DIR="${DIR:-test}"
+BIN="${BIN:-./build/release/purr}"
+RUNS="${RUNS:-20}"
+
+total=0
+
+for file in "$DIR"/*.prr; do
+    start=$(date +%s%N)
+
+    for ((i = 0; i < RUNS; i++)); do
+        echo "purr" | "$BIN" "$file" > /dev/null
+    done
+
+    end=$(date +%s%N)
+    elapsed=$(((end - start) / RUNS / 1000))
+    total=$((total + elapsed))
+
+    printf "%-24s %10d us\n" "$file" "$elapsed"
+done
+
+printf "%-24s %10d us\n" "total" "$total"
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/hash.h"
+#include "../src/table.h"
+
+// Compares hashString() with the byte-at-a-time FNV-1a it replaced, on key
+// sets shaped like what the VM hashes: identifiers, short words, numbers and
+// long lines. Besides speed it reports how well each hash spreads the keys
+// over a table laid out and probed like table.c's: 16-slot groups visited in
+// triangular steps, filled to the 7/8 maximum load, with a 7-bit fragment of
+// the hash in each control byte. Random hashes give the baseline.
+
+#define MAX_KEYS 20000
+
+typedef uint32_t (*HashFn)(const char *key, int length);
+
+typedef struct
+{
+    const char *name;
+    char *keys[MAX_KEYS];
+    int lengths[MAX_KEYS];
+    int count;
+} KeySet;
+
+static uint32_t fnv1a(const char *key, int length)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)key[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+static unsigned seed = 2463534242u;
+
+static unsigned nextRandom()
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void addKey(KeySet *set, const char *key)
+{
+    set->lengths[set->count] = (int)strlen(key);
+    set->keys[set->count++] = strdup(key);
+}
+
+static void makeIdentifiers(KeySet *set)
+{
+    static const char *stems[] = {"count", "index", "node", "value", "total", "item", "list", "name", "left", "right"};
+    char key[64];
+    set->name = "identifiers";
+    for (int i = 0; set->count < MAX_KEYS; i++)
+    {
+        snprintf(key, sizeof(key), "%s%d", stems[i % 10], i / 10);
+        addKey(set, key);
+    }
+}
+
+static void makeWords(KeySet *set)
+{
+    char key[16];
+    set->name = "words 3-10";
+    while (set->count < MAX_KEYS)
+    {
+        int length = 3 + nextRandom() % 8;
+        for (int i = 0; i < length; i++)
+            key[i] = 'a' + nextRandom() % 26;
+        key[length] = '\0';
+        addKey(set, key);
+    }
+}
+
+static void makeNumbers(KeySet *set)
+{
+    char key[16];
+    set->name = "numbers";
+    for (int i = 0; set->count < MAX_KEYS; i++)
+    {
+        snprintf(key, sizeof(key), "%d", i);
+        addKey(set, key);
+    }
+}
+
+static void makeLines(KeySet *set)
+{
+    char key[256];
+    set->name = "lines 200";
+    for (int i = 0; set->count < MAX_KEYS; i++)
+    {
+        snprintf(key, sizeof(key), "%06d,customer,2024-01-01,", i);
+        int length = (int)strlen(key);
+        while (length < 200)
+            key[length++] = 'x';
+        key[length] = '\0';
+        addKey(set, key);
+    }
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static double timeHash(HashFn hash, KeySet *set)
+{
+    volatile uint32_t sink = 0;
+    int rounds = 200;
+
+    double start = now();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (int i = 0; i < set->count; i++)
+            sink += hash(set->keys[i], set->lengths[i]);
+    }
+    (void)sink;
+    return (now() - start) * 1e9 / ((double)rounds * set->count);
+}
+
+// The largest table these many keys can fill to its maximum load.
+static int tableCapacity(int count)
+{
+    int capacity = TABLE_GROUP_SIZE;
+    while (TABLE_MAX_LOAD(capacity * 2) <= count)
+        capacity *= 2;
+    return capacity;
+}
+
+typedef struct
+{
+    double groups;       // Average groups a lookup visits.
+    int longest;         // Most groups any lookup visits.
+    double falseMatches; // Average other keys whose fragment matches on the way.
+} ProbeStats;
+
+// Inserts hashes into a table until it is at its maximum load, as tableSet()
+// would, then looks each one up again the way findSlot() does.
+static ProbeStats probeTable(const uint32_t *hashes, int count)
+{
+    int capacity = tableCapacity(count);
+    count = TABLE_MAX_LOAD(capacity);
+    uint8_t *control = malloc(capacity);
+    int *slots = malloc(sizeof(int) * count);
+    memset(control, CONTROL_EMPTY, capacity);
+
+    for (int i = 0; i < count; i++)
+    {
+        int group = FIRST_GROUP(capacity, hashes[i]);
+        for (int step = 1;; step++)
+        {
+            uint8_t *bytes = control + group * TABLE_GROUP_SIZE;
+            int slot = 0;
+            while (slot < TABLE_GROUP_SIZE && bytes[slot] != CONTROL_EMPTY)
+                slot++;
+            if (slot < TABLE_GROUP_SIZE)
+            {
+                bytes[slot] = FRAGMENT(hashes[i]);
+                slots[i] = group * TABLE_GROUP_SIZE + slot;
+                break;
+            }
+            group = NEXT_GROUP(capacity, group, step);
+        }
+    }
+
+    ProbeStats stats = {0, 0, 0};
+    long groups = 0;
+    long matches = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int group = FIRST_GROUP(capacity, hashes[i]);
+        for (int step = 1;; step++)
+        {
+            uint8_t *bytes = control + group * TABLE_GROUP_SIZE;
+            bool found = false;
+            for (int j = 0; j < TABLE_GROUP_SIZE && !found; j++)
+            {
+                if (group * TABLE_GROUP_SIZE + j == slots[i])
+                    found = true;
+                else if (bytes[j] == FRAGMENT(hashes[i]))
+                    matches++;
+            }
+
+            if (found)
+            {
+                groups += step;
+                if (step > stats.longest)
+                    stats.longest = step;
+                break;
+            }
+            group = NEXT_GROUP(capacity, group, step);
+        }
+    }
+
+    free(control);
+    free(slots);
+    stats.groups = (double)groups / count;
+    stats.falseMatches = (double)matches / count;
+    return stats;
+}
+
+static ProbeStats probeKeys(HashFn hash, KeySet *set)
+{
+    static uint32_t hashes[MAX_KEYS];
+    for (int i = 0; i < set->count; i++)
+        hashes[i] = hash(set->keys[i], set->lengths[i]);
+    return probeTable(hashes, set->count);
+}
+
+static void report(KeySet *set)
+{
+    ProbeStats fnv = probeKeys(fnv1a, set);
+    ProbeStats new = probeKeys(hashString, set);
+    double fnvTime = timeHash(fnv1a, set);
+    double newTime = timeHash(hashString, set);
+
+    static uint32_t hashes[MAX_KEYS];
+    for (int i = 0; i < set->count; i++)
+        hashes[i] = nextRandom();
+    ProbeStats ideal = probeTable(hashes, set->count);
+
+    printf("%-12s %8.2f %8.2f %6.2fx   %5.2f/%-3d %5.2f  %5.2f/%-3d %5.2f  %5.2f/%-3d %5.2f\n", set->name, fnvTime,
+           newTime, fnvTime / newTime, fnv.groups, fnv.longest, fnv.falseMatches, new.groups, new.longest, new.falseMatches,
+           ideal.groups, ideal.longest, ideal.falseMatches);
+
+    for (int i = 0; i < set->count; i++)
+        free(set->keys[i]);
+}
+
+int main()
+{
+    static KeySet sets[4];
+    makeIdentifiers(&sets[0]);
+    makeWords(&sets[1]);
+    makeNumbers(&sets[2]);
+    makeLines(&sets[3]);
+
+    // Each hash shows average/longest groups visited, then false fragment
+    // matches per lookup.
+    printf("%-12s %8s %8s %7s   %-16s %-16s %-16s\n", "keys", "fnv ns", "new ns", "speedup", "fnv groups", "new groups",
+           "random groups");
+    for (int i = 0; i < 4; i++)
+        report(&sets[i]);
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/search.h"
+
+// Times findChars() and countChars() on a megabyte of log lines against the
+// byte-at-a-time loop a script would otherwise run. The Makefile builds this
+// twice, the second time with -DNO_SIMD, to show what the vector kernel adds.
+
+#define LOG_SIZE (1 << 20)
+#define ROUNDS 200
+
+static const char *lines[] = {
+    "2024-03-01 12:00:01 INFO  request served path=/index.html status=200 ms=3\n",
+    "2024-03-01 12:00:02 DEBUG cache lookup key=user:1842 hit=true\n",
+    "2024-03-01 12:00:02 INFO  request served path=/api/items status=200 ms=11\n",
+    "2024-03-01 12:00:03 WARN  slow query table=orders ms=250\n",
+};
+
+static int naiveFind(const char *haystack, int length, const char *needle, int needleLength)
+{
+    for (int i = 0; i + needleLength <= length; i++)
+    {
+        int j = 0;
+        while (j < needleLength && haystack[i + j] == needle[j])
+            j++;
+        if (j == needleLength)
+            return i;
+    }
+    return -1;
+}
+
+static int naiveCount(const char *haystack, int length, const char *needle, int needleLength)
+{
+    int count = 0;
+    int at = 0;
+    int found;
+    while ((found = naiveFind(haystack + at, length - at, needle, needleLength)) >= 0)
+    {
+        count++;
+        at += found + needleLength;
+    }
+    return count;
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+typedef int (*SearchFn)(const char *haystack, int length, const char *needle, int needleLength);
+
+static void run(const char *name, const char *log, int length, const char *needle, SearchFn fast, SearchFn naive)
+{
+    int needleLength = (int)strlen(needle);
+    volatile int sink = 0;
+
+    double start = now();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += naive(log, length, needle, needleLength);
+    double naiveTime = now() - start;
+
+    start = now();
+    for (int i = 0; i < ROUNDS; i++)
+        sink += fast(log, length, needle, needleLength);
+    double fastTime = now() - start;
+
+    (void)sink;
+    double megabytes = (double)length * ROUNDS / (1 << 20);
+    printf("%-28s %10.0f %10.0f %7.1fx\n", name, megabytes / naiveTime, megabytes / fastTime, naiveTime / fastTime);
+}
+
+int main()
+{
+    char *log = malloc(LOG_SIZE + 128);
+    int length = 0;
+    for (int i = 0; length < LOG_SIZE; i++)
+    {
+        const char *line = lines[i % 4];
+        memcpy(log + length, line, strlen(line));
+        length += (int)strlen(line);
+    }
+    // A single error at the very end, so finding it scans everything.
+    const char *last = "2024-03-01 12:00:04 ERROR upstream timeout!\n";
+    memcpy(log + length, last, strlen(last));
+    length += (int)strlen(last);
+
+#if defined(NO_SIMD)
+    printf("scalar kernel\n");
+#elif defined(__AVX2__)
+    printf("AVX2 kernel\n");
+#else
+    printf("SSE2 kernel\n");
+#endif
+    printf("%-28s %10s %10s %8s\n", "search", "loop MB/s", "find MB/s", "speedup");
+    run("find \"ERROR\"", log, length, "ERROR", findChars, naiveFind);
+    run("find \"upstream timeout\"", log, length, "upstream timeout", findChars, naiveFind);
+    run("find \"!\" (one byte)", log, length, "!", findChars, naiveFind);
+    run("count \"INFO\"", log, length, "INFO", countChars, naiveCount);
+    run("count \"status=200\"", log, length, "status=200", countChars, naiveCount);
+
+    free(log);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/slab.h"
+
+// Times the slab allocator against plain malloc on allocation patterns the VM
+// produces: object headers that die young, short string payloads and small
+// arrays that grow by doubling.
+
+#define ROUNDS 64
+#define LIVE 4096
+
+typedef struct
+{
+    void *(*allocate)(size_t size);
+    void *(*resize)(void *pointer, size_t oldSize, size_t newSize);
+    void (*release)(void *pointer, size_t size);
+} Allocator;
+
+static void *mallocAllocate(size_t size)
+{
+    return malloc(size);
+}
+
+static void *mallocResize(void *pointer, size_t oldSize, size_t newSize)
+{
+    (void)oldSize;
+    return realloc(pointer, newSize);
+}
+
+static void mallocRelease(void *pointer, size_t size)
+{
+    (void)size;
+    free(pointer);
+}
+
+static void *slabAllocate(size_t size)
+{
+    return slabRealloc(NULL, 0, size);
+}
+
+static const Allocator mallocAllocator = {mallocAllocate, mallocResize, mallocRelease};
+static const Allocator slabAllocator = {slabAllocate, slabRealloc, slabFree};
+
+static void *slots[LIVE];
+static size_t sizes[LIVE];
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Keeps LIVE blocks alive and keeps replacing them, the way a nursery of
+// strings and list headers churns.
+static size_t churn(const Allocator *allocator, size_t minSize, size_t maxSize)
+{
+    unsigned seed = 12345;
+    size_t operations = 0;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < LIVE; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int slot = (seed >> 8) % LIVE;
+            size_t size = minSize + (seed >> 4) % (maxSize - minSize + 1);
+
+            if (slots[slot] != NULL)
+                allocator->release(slots[slot], sizes[slot]);
+
+            slots[slot] = allocator->allocate(size);
+            memset(slots[slot], 0, size < 16 ? size : 16);
+            sizes[slot] = size;
+            operations++;
+        }
+    }
+
+    for (int i = 0; i < LIVE; i++)
+    {
+        allocator->release(slots[i], sizes[i]);
+        slots[i] = NULL;
+    }
+    return operations;
+}
+
+// Grows small arrays by doubling from 8 bytes up to 256 and frees them.
+static size_t grow(const Allocator *allocator)
+{
+    size_t operations = 0;
+
+    for (int round = 0; round < ROUNDS * 4; round++)
+    {
+        for (int i = 0; i < LIVE / 4; i++)
+        {
+            size_t size = 8;
+            void *array = allocator->allocate(size);
+            while (size < 256)
+            {
+                array = allocator->resize(array, size, size * 2);
+                size *= 2;
+                operations++;
+            }
+            allocator->release(array, size);
+            operations += 2;
+        }
+    }
+    return operations;
+}
+
+static void run(const char *name, size_t (*benchmark)(const Allocator *, size_t, size_t), size_t minSize,
+                size_t maxSize)
+{
+    double start = now();
+    size_t operations = benchmark(&mallocAllocator, minSize, maxSize);
+    double mallocTime = now() - start;
+
+    start = now();
+    benchmark(&slabAllocator, minSize, maxSize);
+    double slabTime = now() - start;
+
+    printf("%-16s %10.2f %10.2f %8.2fx\n", name, mallocTime * 1e9 / operations, slabTime * 1e9 / operations,
+           mallocTime / slabTime);
+}
+
+static size_t growBenchmark(const Allocator *allocator, size_t minSize, size_t maxSize)
+{
+    (void)minSize;
+    (void)maxSize;
+    return grow(allocator);
+}
+
+int main()
+{
+    printf("%-16s %10s %10s %9s\n", "pattern", "malloc ns", "slab ns", "speedup");
+    run("headers 32-48", churn, 32, 48);
+    run("strings 2-64", churn, 2, 64);
+    run("mixed 8-256", churn, 8, 256);
+    run("grow 8-256", growBenchmark, 0, 0);
+
+    freeSlabs();
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "bitset.h"
+
+// Everything here works a word at a time. The plain loops over words are left
+// for the compiler to vectorize, and popcount and count-trailing-zeros become
+// single instructions when the target has them.
+
+// Sets or clears the bits in [start, end).
+void fillBitset(ObjBitset *bitset, int start, int end, bool value)
+{
+    if (start >= end)
+        return;
+
+    int first = start >> 6;
+    int last = (end - 1) >> 6;
+    uint64_t firstMask = ~(uint64_t)0 << (start & 63);
+    uint64_t lastMask = ~(uint64_t)0 >> (63 - ((end - 1) & 63));
+    if (first == last)
+        firstMask &= lastMask;
+
+    uint64_t *words = bitset->words;
+    words[first] = value ? words[first] | firstMask : words[first] & ~firstMask;
+    if (first == last)
+        return;
+
+    memset(words + first + 1, value ? 0xff : 0, sizeof(uint64_t) * (last - first - 1));
+    words[last] = value ? words[last] | lastMask : words[last] & ~lastMask;
+}
+
+int countBitset(ObjBitset *bitset)
+{
+    int count = 0;
+    for (int i = 0; i < BITSET_WORDS(bitset->length); i++)
+    {
+        count += __builtin_popcountll(bitset->words[i]);
+    }
+    return count;
+}
+
+// Returns the first set bit at or after `from`, or -1.
+int nextSetBit(ObjBitset *bitset, int from)
+{
+    if (from < 0)
+        from = 0;
+    if (from >= bitset->length)
+        return -1;
+
+    int index = from >> 6;
+    uint64_t word = bitset->words[index] & (~(uint64_t)0 << (from & 63));
+    while (word == 0)
+    {
+        if (++index == BITSET_WORDS(bitset->length))
+            return -1;
+        word = bitset->words[index];
+    }
+    return index * 64 + __builtin_ctzll(word);
+}
+
+// The three bitsets must have the same length. The result may be an operand.
+void combineBitsets(ObjBitset *result, ObjBitset *a, ObjBitset *b, BitsetOp op)
+{
+    int count = BITSET_WORDS(result->length);
+    uint64_t *out = result->words;
+    const uint64_t *x = a->words;
+    const uint64_t *y = b->words;
+
+    switch (op)
+    {
+    case BITSET_AND:
+        for (int i = 0; i < count; i++)
+            out[i] = x[i] & y[i];
+        break;
+    case BITSET_OR:
+        for (int i = 0; i < count; i++)
+            out[i] = x[i] | y[i];
+        break;
+    case BITSET_XOR:
+        for (int i = 0; i < count; i++)
+            out[i] = x[i] ^ y[i];
+        break;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef purr_bitset_h
+#define purr_bitset_h
+
+#include "common.h"
+#include "object.h"
+
+typedef enum
+{
+    BITSET_AND,
+    BITSET_OR,
+    BITSET_XOR
+} BitsetOp;
+
+static inline bool bitsetGet(ObjBitset *bitset, int index)
+{
+    return (bitset->words[index >> 6] >> (index & 63)) & 1;
+}
+
+static inline void bitsetSet(ObjBitset *bitset, int index, bool value)
+{
+    uint64_t mask = (uint64_t)1 << (index & 63);
+    if (value)
+        bitset->words[index >> 6] |= mask;
+    else
+        bitset->words[index >> 6] &= ~mask;
+}
+
+void fillBitset(ObjBitset *bitset, int start, int end, bool value);
+int countBitset(ObjBitset *bitset);
+int nextSetBit(ObjBitset *bitset, int from);
+void combineBitsets(ObjBitset *result, ObjBitset *a, ObjBitset *b, BitsetOp op);
+
+#endif
@@ -8,6 +8,8 @@ void initChunk(Chunk *chunk)
     chunk->count = 0;
     chunk->capacity = 0;
     chunk->code = NULL;
+    chunk->lineCount = 0;
+    chunk->lineCapacity = 0;
     chunk->lines = NULL;
     initValueArray(&chunk->constants);
 }
@@ -15,7 +17,7 @@ void initChunk(Chunk *chunk)
 void freeChunk(Chunk *chunk)
 {
     FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    FREE_ARRAY(int, chunk->lines, chunk->capacity);
+    FREE_ARRAY(LineStart, chunk->lines, chunk->lineCapacity);
     freeValueArray(&chunk->constants);
     initChunk(chunk);
 }
@@ -27,16 +29,69 @@ void writeChunk(Chunk *chunk, uint8_t byte, int line)
         int oldCapacity = chunk->capacity;
         chunk->capacity = GROW_CAPACITY(oldCapacity);
         chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-        chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
     }
 
     chunk->code[chunk->count] = byte;
-    chunk->lines[chunk->count] = line;
     chunk->count++;
+
+    // Only record where the line changes.
+    if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == line)
+        return;
+
+    if (chunk->lineCapacity < chunk->lineCount + 1)
+    {
+        int oldCapacity = chunk->lineCapacity;
+        chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
+        chunk->lines = GROW_ARRAY(LineStart, chunk->lines, oldCapacity, chunk->lineCapacity);
+    }
+
+    LineStart *lineStart = &chunk->lines[chunk->lineCount++];
+    lineStart->offset = chunk->count - 1;
+    lineStart->line = line;
+}
+
+// Drops the bytecode from `count` on, along with the line runs that start there.
+void truncateChunk(Chunk *chunk, int count)
+{
+    chunk->count = count;
+    while (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].offset >= count)
+        chunk->lineCount--;
+}
+
+// Releases the spare capacity left by growing, once nothing more will be written.
+void shrinkChunk(Chunk *chunk)
+{
+    chunk->code = GROW_ARRAY(uint8_t, chunk->code, chunk->capacity, chunk->count);
+    chunk->capacity = chunk->count;
+
+    chunk->lines = GROW_ARRAY(LineStart, chunk->lines, chunk->lineCapacity, chunk->lineCount);
+    chunk->lineCapacity = chunk->lineCount;
+
+    ValueArray *constants = &chunk->constants;
+    constants->values = GROW_ARRAY(Value, constants->values, constants->capacity, constants->count);
+    constants->capacity = constants->count;
 }
 
 int addConstant(Chunk *chunk, Value value)
 {
     writeValueArray(&chunk->constants, value);
     return chunk->constants.count - 1;
-}
\ No newline at end of file
+}
+
+int getLine(Chunk *chunk, int offset)
+{
+    int start = 0;
+    int end = chunk->lineCount - 1;
+
+    // Find the last run that starts at or before the offset.
+    while (start < end)
+    {
+        int mid = start + (end - start + 1) / 2;
+        if (chunk->lines[mid].offset <= offset)
+            start = mid;
+        else
+            end = mid - 1;
+    }
+
+    return chunk->lines[start].line;
+}
@@ -17,11 +17,14 @@ typedef enum
     OP_DEFINE_GLOBAL,
     OP_SET_GLOBAL,
     OP_BUILD_LIST,
+    OP_BUILD_DICT,
     OP_INDEX_SUBSCR,
     OP_STORE_SUBSCR,
+    OP_SLICE,
     OP_EQUAL,
     OP_GREATER,
     OP_LESS,
+    OP_IN,
     OP_ADD,
     OP_SUBTRACT,
     OP_MULTIPLY,
@@ -41,21 +44,63 @@ typedef enum
     OP_JUMP_IF_FALSE,
     OP_LOOP,
     OP_CALL,
+    OP_TAIL_CALL,
     OP_RETURN,
+    // Forms with a 24-bit big-endian operand, emitted only when it exceeds a byte.
+    OP_CONSTANT_LONG,
+    OP_GET_LOCAL_LONG,
+    OP_SET_LOCAL_LONG,
+    OP_GET_GLOBAL_LONG,
+    OP_DEFINE_GLOBAL_LONG,
+    OP_SET_GLOBAL_LONG,
+    OP_BUILD_LIST_LONG,
+    OP_BUILD_DICT_LONG,
+    // Superinstructions fused by the compiler from common sequences.
+    OP_JUMP_IF_NOT_EQUAL,   // OP_EQUAL, OP_JUMP_IF_FALSE, OP_POP
+    OP_JUMP_IF_EQUAL,       // OP_EQUAL, OP_NOT, OP_JUMP_IF_FALSE, OP_POP
+    OP_JUMP_IF_NOT_GREATER, // OP_GREATER, OP_JUMP_IF_FALSE, OP_POP
+    OP_JUMP_IF_GREATER,     // OP_GREATER, OP_NOT, OP_JUMP_IF_FALSE, OP_POP
+    OP_JUMP_IF_NOT_LESS,    // OP_LESS, OP_JUMP_IF_FALSE, OP_POP
+    OP_JUMP_IF_LESS,        // OP_LESS, OP_NOT, OP_JUMP_IF_FALSE, OP_POP
+    OP_INCR_LOCAL,          // OP_GET_LOCAL, OP_CONSTANT, OP_ADD, OP_SET_LOCAL, OP_POP
+    OP_ADD_LOCALS,          // OP_GET_LOCAL, OP_GET_LOCAL, OP_ADD
+    OP_INDEX_SUBSCR2,       // OP_INDEX_SUBSCR, <index>, OP_INDEX_SUBSCR
+    // Type-specialized variants the VM rewrites generic instructions into.
+    OP_ADD_INT,
+    OP_ADD_DOUBLE,
+    OP_MULTIPLY_INT,
+    OP_MULTIPLY_DOUBLE,
+    OP_INDEX_LIST_INT,
+    OP_INDEX2_LIST_INT,
+    OP_STORE_LIST_INT,
+    OP_INDEX_BITSET_INT,
+    OP_STORE_BITSET_INT,
 } OpCode;
 
+// Marks where a run of bytecode compiled from one source line begins.
+typedef struct
+{
+    int offset;
+    int line;
+} LineStart;
+
 typedef struct
 {
     int count;
     int capacity;
     uint8_t *code;
-    int *lines;
+    int lineCount;
+    int lineCapacity;
+    LineStart *lines;
     ValueArray constants;
 } Chunk;
 
 void initChunk(Chunk *chunk);
 void freeChunk(Chunk *chunk);
 void writeChunk(Chunk *chunk, uint8_t byte, int line);
+void truncateChunk(Chunk *chunk, int count);
+void shrinkChunk(Chunk *chunk);
 int addConstant(Chunk *chunk, Value value);
+int getLine(Chunk *chunk, int offset);
 
 #endif
\ No newline at end of file
@@ -8,6 +8,25 @@
 // #define DEBUG_PRINT_CODE
 // #define DEBUG_TRACE_EXECUTION
 
+// Collect garbage on every allocation that grows the heap, and log what the
+// collector does.
+// #define DEBUG_STRESS_GC
+// #define DEBUG_LOG_GC
+
+// Threaded dispatch needs GCC's labels-as-values extension. Build with
+// -DNO_COMPUTED_GOTO to force the portable switch-based loop.
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+// Pack every Value into a single 64-bit word by hiding non-number values in
+// the unused bits of a quiet NaN. Build with -DNO_NAN_BOXING to fall back
+// to the tagged-union representation.
+#if !defined(NO_NAN_BOXING)
+#define NAN_BOXING
+#endif
+
 #define UINT8_COUNT (UINT8_MAX + 1)
+#define UINT24_MAX 0xffffff
 
 #endif
\ No newline at end of file
@@ -1,10 +1,14 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "common.h"
 #include "compiler.h"
+#include "escape.h"
+#include "memory.h"
 #include "scanner.h"
+#include "vm.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -60,15 +64,31 @@ typedef enum
     TYPE_SCRIPT
 } FunctionType;
 
+#define RECENT_INSTRUCTIONS 4
+
 typedef struct Compiler
 {
     struct Compiler *enclosing;
     ObjFunction *function;
     FunctionType type;
 
-    Local locals[UINT8_COUNT];
+    Local *locals;
     int localCount;
+    int localCapacity;
     int scopeDepth;
+
+    // Open-addressed map from constant values to their index in the chunk,
+    // stored as index + 1 so zero marks an empty slot.
+    int *constantSlots;
+    int constantCapacity;
+
+    // Peephole state for fusing superinstructions: the start offsets of the
+    // latest instructions (newest first, -1 when unknown), how many operand
+    // bytes of the newest one are still to be emitted, and the highest offset
+    // any jump lands on.
+    int recent[RECENT_INSTRUCTIONS];
+    int pendingOperands;
+    int lastJumpTarget;
 } Compiler;
 
 Parser parser;
@@ -158,8 +178,62 @@ static bool match(TokenType type)
     return true;
 }
 
+static int operandCount(uint8_t instruction)
+{
+    switch (instruction)
+    {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_BUILD_LIST:
+    case OP_BUILD_DICT:
+    case OP_CALL:
+    case OP_TAIL_CALL:
+        return 1;
+    case OP_CONSTANT_LONG:
+    case OP_GET_LOCAL_LONG:
+    case OP_SET_LOCAL_LONG:
+    case OP_GET_GLOBAL_LONG:
+    case OP_DEFINE_GLOBAL_LONG:
+    case OP_SET_GLOBAL_LONG:
+    case OP_BUILD_LIST_LONG:
+    case OP_BUILD_DICT_LONG:
+        return 3;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+    case OP_JUMP_IF_NOT_EQUAL:
+    case OP_JUMP_IF_EQUAL:
+    case OP_JUMP_IF_NOT_GREATER:
+    case OP_JUMP_IF_GREATER:
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_LESS:
+    case OP_INCR_LOCAL:
+    case OP_ADD_LOCALS:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
 static void emitByte(uint8_t byte)
 {
+    if (current->pendingOperands > 0)
+    {
+        current->pendingOperands--;
+    }
+    else
+    {
+        for (int i = RECENT_INSTRUCTIONS - 1; i > 0; i--)
+            current->recent[i] = current->recent[i - 1];
+
+        current->recent[0] = currentChunk()->count;
+        current->pendingOperands = operandCount(byte);
+    }
+
     writeChunk(currentChunk(), byte, parser.previous.line);
 }
 
@@ -169,6 +243,43 @@ static void emitBytes(uint8_t byte1, uint8_t byte2)
     emitByte(byte2);
 }
 
+// Returns the opcode of the instruction emitted `distance` instructions ago,
+// or -1 if it is unknown.
+static int recentOp(int distance)
+{
+    int offset = current->recent[distance];
+    return offset == -1 ? -1 : currentChunk()->code[offset];
+}
+
+static uint8_t recentOperand(int distance, int index)
+{
+    return currentChunk()->code[current->recent[distance] + 1 + index];
+}
+
+// Checks whether the latest `count` instructions can be replaced by one
+// fused instruction, i.e. they are all known and no jump lands between them.
+static bool canFuse(int count)
+{
+    int start = current->recent[count - 1];
+    return start != -1 && current->lastJumpTarget <= start;
+}
+
+// Drops the latest `count` instructions so a fused one can be emitted in
+// their place.
+static void removeRecent(int count)
+{
+    truncateChunk(currentChunk(), current->recent[count - 1]);
+
+    for (int i = 0; i < RECENT_INSTRUCTIONS; i++)
+        current->recent[i] = i + count < RECENT_INSTRUCTIONS ? current->recent[i + count] : -1;
+}
+
+static void markJumpTarget(int offset)
+{
+    if (offset > current->lastJumpTarget)
+        current->lastJumpTarget = offset;
+}
+
 static void emitLoop(int loopStart)
 {
     emitByte(OP_LOOP);
@@ -195,21 +306,115 @@ static void emitReturn()
     emitByte(OP_RETURN);
 }
 
-static uint8_t makeConstant(Value value)
+// Emits `instruction` with a one-byte operand, or `longInstruction` with a
+// 24-bit one when the operand does not fit.
+static void emitOperand(uint8_t instruction, uint8_t longInstruction, int operand)
 {
-    int constant = addConstant(currentChunk(), value);
-    if (constant > UINT8_MAX)
+    if (operand <= UINT8_MAX)
+    {
+        emitBytes(instruction, (uint8_t)operand);
+        return;
+    }
+
+    emitByte(longInstruction);
+    emitByte((operand >> 16) & 0xff);
+    emitByte((operand >> 8) & 0xff);
+    emitByte(operand & 0xff);
+}
+
+// Constants are only shared when they have the same type and bits, so 1 and
+// 1.0 stay apart. Strings are interned, which makes their pointers enough.
+static uint64_t constantBits(Value value)
+{
+#ifdef NAN_BOXING
+    return value;
+#else
+    uint64_t bits = 0;
+    switch (value.type)
+    {
+    case VAL_DOUBLE:
+        memcpy(&bits, &value.as.number, sizeof(double));
+        break;
+    case VAL_INT:
+        bits = (uint64_t)value.as.integer;
+        break;
+    case VAL_OBJ:
+        bits = (uint64_t)(uintptr_t)value.as.obj;
+        break;
+    case VAL_BOOL:
+        bits = value.as.boolean;
+        break;
+    default:
+        break;
+    }
+    return bits;
+#endif
+}
+
+static bool sameConstant(Value a, Value b)
+{
+#ifdef NAN_BOXING
+    return a == b;
+#else
+    return a.type == b.type && constantBits(a) == constantBits(b);
+#endif
+}
+
+static int constantSlot(int *slots, int capacity, Value value)
+{
+    uint64_t hash = constantBits(value) * 0x9e3779b97f4a7c15u;
+    int index = (int)((hash >> 32) & (uint64_t)(capacity - 1));
+    Value *constants = currentChunk()->constants.values;
+
+    while (slots[index] != 0 && !sameConstant(constants[slots[index] - 1], value))
+        index = (index + 1) & (capacity - 1);
+
+    return index;
+}
+
+static int makeConstant(Value value)
+{
+    ValueArray *constants = &currentChunk()->constants;
+
+    // Keep the value reachable while the map and the constant array grow.
+    push(value);
+
+    if (constants->count + 1 > current->constantCapacity / 2)
+    {
+        int capacity = GROW_CAPACITY(current->constantCapacity);
+        int *slots = ALLOCATE(int, capacity);
+        memset(slots, 0, sizeof(int) * capacity);
+
+        for (int i = 0; i < constants->count; i++)
+            slots[constantSlot(slots, capacity, constants->values[i])] = i + 1;
+
+        FREE_ARRAY(int, current->constantSlots, current->constantCapacity);
+        current->constantSlots = slots;
+        current->constantCapacity = capacity;
+    }
+
+    int slot = constantSlot(current->constantSlots, current->constantCapacity, value);
+    int constant = current->constantSlots[slot] - 1;
+    if (constant == -1)
+    {
+        constant = addConstant(currentChunk(), value);
+        current->constantSlots[slot] = constant + 1;
+        writeBarrier((Obj *)current->function, value);
+    }
+    pop();
+
+    if (constant > UINT24_MAX)
     {
         error("Too many constants in one chunk.");
         return 0;
     }
 
-    return (uint8_t)constant;
+    return constant;
 }
 
 static void emitConstant(Value value)
 {
-    emitBytes(OP_CONSTANT, makeConstant(value));
+    emitOperand(OP_CONSTANT, OP_CONSTANT_LONG, makeConstant(value));
 }
 
 static void patchJump(int offset)
@@ -224,6 +429,7 @@ static void patchJump(int offset)
 
     currentChunk()->code[offset] = (jump >> 8) & 0xff;
     currentChunk()->code[offset + 1] = jump & 0xff;
+    markJumpTarget(currentChunk()->count);
 }
 
 static void initCompiler(Compiler *compiler, FunctionType type)
@@ -231,14 +437,23 @@ static void initCompiler(Compiler *compiler, FunctionType type)
     compiler->enclosing = current;
     compiler->function = NULL;
     compiler->type = type;
+    compiler->localCapacity = 8;
+    compiler->locals = ALLOCATE(Local, compiler->localCapacity);
     compiler->localCount = 0;
     compiler->scopeDepth = 0;
+    compiler->constantSlots = NULL;
+    compiler->constantCapacity = 0;
+    for (int i = 0; i < RECENT_INSTRUCTIONS; i++)
+        compiler->recent[i] = -1;
+    compiler->pendingOperands = 0;
+    compiler->lastJumpTarget = 0;
     compiler->function = newFunction();
     current = compiler;
 
     if (type != TYPE_SCRIPT)
     {
         current->function->name = copyString(parser.previous.start, parser.previous.length);
+        writeBarrier((Obj *)current->function, OBJ_VAL(current->function->name));
     }
 
     Local *local = &current->locals[current->localCount++];
@@ -247,10 +462,152 @@ static void initCompiler(Compiler *compiler, FunctionType type)
     local->name.length = 0;
 }
 
+// Slots kept free above the deepest point of the bytecode for the temporaries
+// that runtime helpers and natives push to protect new objects from the GC.
+#define STACK_RESERVE 4
+
+// Walks the finished bytecode once and returns the deepest the value stack can
+// get while the function runs, counting the callee slot and its arguments. The
+// compiler only emits structured control flow, so every forward jump lands at a
+// known depth and backward loops never raise it.
+static int maxStackDepth(Chunk *chunk, int arity)
+{
+    int *targetDepth = ALLOCATE(int, chunk->count + 1);
+    for (int i = 0; i <= chunk->count; i++)
+        targetDepth[i] = -1;
+
+    int depth = arity + 1;
+    int maxDepth = depth;
+    bool reachable = true;
+
+    for (int offset = 0; offset < chunk->count; offset += 1 + operandCount(chunk->code[offset]))
+    {
+        if (targetDepth[offset] >= 0 && (!reachable || targetDepth[offset] > depth))
+            depth = targetDepth[offset];
+        reachable = true;
+
+        uint8_t instruction = chunk->code[offset];
+        int peak = depth;
+        int jumpDepth = -1;
+
+        switch (instruction)
+        {
+        case OP_CONSTANT:
+        case OP_NONE:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_CONSTANT_LONG:
+        case OP_GET_LOCAL_LONG:
+        case OP_GET_GLOBAL_LONG:
+            depth++;
+            break;
+        case OP_ADD_LOCALS:
+            // Pushes both operands when it falls back to concatenation.
+            peak = depth + 2;
+            depth++;
+            break;
+        case OP_BUILD_LIST:
+            // The new list sits on top of its items while they are appended.
+            peak = depth + 1;
+            depth += 1 - chunk->code[offset + 1];
+            break;
+        case OP_BUILD_LIST_LONG:
+            peak = depth + 1;
+            depth += 1 - ((chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+            break;
+        case OP_BUILD_DICT:
+            // Like OP_BUILD_LIST, with a key and a value per entry.
+            peak = depth + 1;
+            depth += 1 - 2 * chunk->code[offset + 1];
+            break;
+        case OP_BUILD_DICT_LONG:
+            peak = depth + 1;
+            depth +=
+                1 - 2 * ((chunk->code[offset + 1] << 16) | (chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+            break;
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            depth -= chunk->code[offset + 1];
+            break;
+        case OP_POP:
+        case OP_DEFINE_GLOBAL:
+        case OP_DEFINE_GLOBAL_LONG:
+        case OP_INDEX_SUBSCR:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_IN:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_INTDIV:
+        case OP_MOD:
+        case OP_POW:
+        case OP_BAND:
+        case OP_BOR:
+        case OP_XOR:
+        case OP_LSHIFT:
+        case OP_RSHIFT:
+            depth--;
+            break;
+        case OP_STORE_SUBSCR:
+        case OP_SLICE:
+        case OP_INDEX_SUBSCR2:
+            depth -= 2;
+            break;
+        case OP_JUMP_IF_FALSE:
+            jumpDepth = depth;
+            break;
+        case OP_JUMP_IF_NOT_EQUAL:
+        case OP_JUMP_IF_EQUAL:
+        case OP_JUMP_IF_NOT_GREATER:
+        case OP_JUMP_IF_GREATER:
+        case OP_JUMP_IF_NOT_LESS:
+        case OP_JUMP_IF_LESS:
+            depth -= 2;
+            jumpDepth = depth;
+            break;
+        case OP_JUMP:
+            jumpDepth = depth;
+            reachable = false;
+            break;
+        case OP_LOOP:
+        case OP_RETURN:
+            reachable = false;
+            break;
+        default:
+            break;
+        }
+
+        if (jumpDepth >= 0)
+        {
+            int target = offset + 3 + ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+            if (target <= chunk->count && jumpDepth > targetDepth[target])
+                targetDepth[target] = jumpDepth;
+        }
+
+        if (peak > maxDepth)
+            maxDepth = peak;
+        if (depth > maxDepth)
+            maxDepth = depth;
+    }
+
+    FREE_ARRAY(int, targetDepth, chunk->count + 1);
+    return maxDepth;
+}
+
 static ObjFunction *endCompiler()
 {
     emitReturn();
     ObjFunction *function = current->function;
+    function->stackSize = maxStackDepth(&function->chunk, function->arity) + STACK_RESERVE;
+
+    shrinkChunk(&function->chunk);
+    FREE_ARRAY(Local, current->locals, current->localCapacity);
+    FREE_ARRAY(int, current->constantSlots, current->constantCapacity);
 
 #ifdef DEBUG_PRINT_CODE
     if (!parser.hadError)
@@ -285,9 +642,16 @@ static void declaration();
 static ParseRule *getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
 
-static uint8_t identifierConstant(Token *name)
+static int globalVariable(Token *name)
 {
-    return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+    int slot = globalSlot(copyString(name->start, name->length));
+    if (slot > UINT24_MAX)
+    {
+        error("Too many global variables.");
+        return 0;
+    }
+
+    return slot;
 }
 
 static bool identifiersEqual(Token *a, Token *b)
@@ -319,12 +683,19 @@ static int resolveLocal(Compiler *compiler, Token *name)
 
 static void addLocal(Token name)
 {
-    if (current->localCount == UINT8_COUNT)
+    if (current->localCount > UINT24_MAX)
     {
         error("Too many local variables in function.");
         return;
     }
 
+    if (current->localCount == current->localCapacity)
+    {
+        int oldCapacity = current->localCapacity;
+        current->localCapacity = GROW_CAPACITY(oldCapacity);
+        current->locals = GROW_ARRAY(Local, current->locals, oldCapacity, current->localCapacity);
+    }
+
     Local *local = &current->locals[current->localCount++];
     local->name = name;
     local->depth = -1;
@@ -355,7 +726,7 @@ static void declareVariable()
     addLocal(*name);
 }
 
-static uint8_t parseVariable(const char *errorMessage)
+static int parseVariable(const char *errorMessage)
 {
     consume(TOKEN_IDENTIFIER, errorMessage);
 
@@ -363,7 +734,7 @@ static uint8_t parseVariable(const char *errorMessage)
     if (current->scopeDepth > 0)
         return 0;
 
-    return identifierConstant(&parser.previous);
+    return globalVariable(&parser.previous);
 }
 
 static void markInitialized()
@@ -373,7 +744,7 @@ static void markInitialized()
     current->locals[current->localCount - 1].depth = current->scopeDepth;
 }
 
-static void defineVariable(uint8_t global)
+static void defineVariable(int global)
 {
     if (current->scopeDepth > 0)
     {
@@ -381,7 +752,7 @@ static void defineVariable(uint8_t global)
         return;
     }
 
-    emitBytes(OP_DEFINE_GLOBAL, global);
+    emitOperand(OP_DEFINE_GLOBAL, OP_DEFINE_GLOBAL_LONG, global);
 }
 
 static uint8_t argumentList()
@@ -439,8 +810,22 @@ static void binary(bool canAssign)
     case TOKEN_LESS_EQUAL:
         emitBytes(OP_GREATER, OP_NOT);
         break;
+    case TOKEN_IN:
+        emitByte(OP_IN);
+        break;
     case TOKEN_PLUS:
-        emitByte(OP_ADD);
+        if (recentOp(0) == OP_GET_LOCAL && recentOp(1) == OP_GET_LOCAL && canFuse(2))
+        {
+            uint8_t a = recentOperand(1, 0);
+            uint8_t b = recentOperand(0, 0);
+            removeRecent(2);
+            emitByte(OP_ADD_LOCALS);
+            emitBytes(a, b);
+        }
+        else
+        {
+            emitByte(OP_ADD);
+        }
         break;
     case TOKEN_MINUS:
         emitByte(OP_SUBTRACT);
@@ -470,10 +855,10 @@ static void binary(bool canAssign)
         emitByte(OP_XOR);
         break;
     case TOKEN_GREATER_GREATER:
-        emitByte(OP_LSHIFT);
+        emitByte(OP_RSHIFT);
         break;
     case TOKEN_LESS_LESS:
-        emitByte(OP_RSHIFT);
+        emitByte(OP_LSHIFT);
         break;
     default:
         return; // Unreachable.
@@ -512,6 +897,17 @@ static void grouping(bool canAssign)
 
 static void number(bool canAssign)
 {
+    if (memchr(parser.previous.start, '.', parser.previous.length) == NULL)
+    {
+        errno = 0;
+        long long value = strtoll(parser.previous.start, NULL, 10);
+        if (errno == 0 && INT_FITS(value))
+        {
+            emitConstant(INT_VAL(value));
+            return;
+        }
+    }
+
     double value = strtod(parser.previous.start, NULL);
     emitConstant(NUMBER_VAL(value));
 }
@@ -530,34 +926,45 @@ static void or_(bool canAssign)
 
 static void string(bool canAssign)
 {
-    emitConstant(OBJ_VAL(copyString(parser.previous.start + 1, parser.previous.length - 2)));
+    // Escapes are decoded once here, so the constant holds the real bytes.
+    const char *raw = parser.previous.start + 1;
+    int rawLength = parser.previous.length - 2;
+    char *chars = ALLOCATE(char, rawLength + 1);
+    int length = convert_string(raw, rawLength, chars);
+
+    emitConstant(OBJ_VAL(copyString(chars, length)));
+    FREE_ARRAY(char, chars, rawLength + 1);
 }
 
 static void namedVariable(Token name, bool canAssign)
 {
-    uint8_t getOp, setOp;
+    uint8_t getOp, setOp, getLongOp, setLongOp;
     int arg = resolveLocal(current, &name);
 
     if (arg != -1)
     {
         getOp = OP_GET_LOCAL;
         setOp = OP_SET_LOCAL;
+        getLongOp = OP_GET_LOCAL_LONG;
+        setLongOp = OP_SET_LOCAL_LONG;
     }
     else
     {
-        arg = identifierConstant(&name);
+        arg = globalVariable(&name);
         getOp = OP_GET_GLOBAL;
         setOp = OP_SET_GLOBAL;
+        getLongOp = OP_GET_GLOBAL_LONG;
+        setLongOp = OP_SET_GLOBAL_LONG;
     }
 
     if (canAssign && match(TOKEN_EQUAL))
     {
         expression();
-        emitBytes(setOp, (uint8_t)arg);
+        emitOperand(setOp, setLongOp, arg);
     }
     else
     {
-        emitBytes(getOp, (uint8_t)arg);
+        emitOperand(getOp, getLongOp, arg);
     }
 }
 
@@ -605,9 +1012,9 @@ static void list(bool canAssign)
 
             parsePrecedence(PREC_OR);
 
-            if (itemCount == UINT8_COUNT)
+            if (itemCount == UINT24_MAX)
             {
-                error("Cannot have more than 256 items in a list literal.");
+                error("Too many items in a list literal.");
             }
             itemCount++;
         } while (match(TOKEN_COMMA));
@@ -615,14 +1022,67 @@ static void list(bool canAssign)
 
     consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list literal.");
 
-    emitByte(OP_BUILD_LIST);
-    emitByte(itemCount);
-    return;
+    emitOperand(OP_BUILD_LIST, OP_BUILD_LIST_LONG, itemCount);
+}
+
+static void dict(bool canAssign)
+{
+    // parsePrecedence() rejects `{...} = value` as an invalid target.
+    (void)canAssign;
+    int entryCount = 0;
+    if (!check(TOKEN_RIGHT_BRACE))
+    {
+        do
+        {
+            if (check(TOKEN_RIGHT_BRACE))
+            {
+                // Trailing comma case
+                break;
+            }
+
+            parsePrecedence(PREC_OR);
+            consume(TOKEN_COLON, "Expect ':' after dict key.");
+            parsePrecedence(PREC_OR);
+
+            if (entryCount == UINT24_MAX)
+            {
+                error("Too many entries in a dict literal.");
+            }
+            entryCount++;
+        } while (match(TOKEN_COMMA));
+    }
+
+    consume(TOKEN_RIGHT_BRACE, "Expect '}' after dict literal.");
+
+    emitOperand(OP_BUILD_DICT, OP_BUILD_DICT_LONG, entryCount);
+}
+
+// Compiles the end of collection[start:end] once the start is on the stack.
+// Either bound may be left out. Slices cannot be assigned to.
+static void slice()
+{
+    if (check(TOKEN_RIGHT_BRACKET))
+        emitByte(OP_NONE);
+    else
+        parsePrecedence(PREC_OR);
+
+    consume(TOKEN_RIGHT_BRACKET, "Expect ']' after slice.");
+    emitByte(OP_SLICE);
 }
 
 static void subscript(bool canAssign)
 {
-    parsePrecedence(PREC_OR);
+    if (check(TOKEN_COLON))
+        emitByte(OP_NONE);
+    else
+        parsePrecedence(PREC_OR);
+
+    if (match(TOKEN_COLON))
+    {
+        slice();
+        return;
+    }
+
     consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
 
     if (canAssign && match(TOKEN_EQUAL))
@@ -630,6 +1090,17 @@ static void subscript(bool canAssign)
         expression();
         emitByte(OP_STORE_SUBSCR);
     }
+    else if (recentOp(1) == OP_INDEX_SUBSCR && (recentOp(0) == OP_GET_LOCAL || recentOp(0) == OP_CONSTANT) &&
+             canFuse(2))
+    {
+        // a[i][j] with a side-effect free j: load j before the first lookup and
+        // index twice in one instruction.
+        uint8_t loadOp = recentOp(0);
+        uint8_t operand = recentOperand(0, 0);
+        removeRecent(2);
+        emitBytes(loadOp, operand);
+        emitByte(OP_INDEX_SUBSCR2);
+    }
     else
     {
         emitByte(OP_INDEX_SUBSCR);
@@ -642,6 +1113,8 @@ ParseRule rules[] = {
     [TOKEN_RIGHT_PAREN] = {NULL, NULL, PREC_NONE},
     [TOKEN_LEFT_BRACKET] = {list, subscript, PREC_SUBSCRIPT},
     [TOKEN_RIGHT_BRACKET] = {NULL, NULL, PREC_NONE},
+    [TOKEN_LEFT_BRACE] = {dict, NULL, PREC_NONE},
+    [TOKEN_RIGHT_BRACE] = {NULL, NULL, PREC_NONE},
     [TOKEN_COMMA] = {NULL, NULL, PREC_NONE},
     [TOKEN_DOT] = {NULL, NULL, PREC_NONE},
     [TOKEN_MINUS] = {unary, binary, PREC_TERM},
@@ -677,6 +1150,7 @@ ParseRule rules[] = {
     [TOKEN_END] = {NULL, NULL, PREC_NONE},
     [TOKEN_FALSE] = {literal, NULL, PREC_NONE},
     [TOKEN_IF] = {NULL, NULL, PREC_NONE},
+    [TOKEN_IN] = {NULL, binary, PREC_COMPARISON},
     [TOKEN_NONE] = {literal, NULL, PREC_NONE},
     [TOKEN_NOT] = {unary, NULL, PREC_NONE},
     [TOKEN_OR] = {NULL, or_, PREC_OR},
@@ -756,14 +1230,14 @@ static void function(FunctionType type)
     }
 
     ObjFunction *function = endCompiler();
-    emitBytes(OP_CONSTANT, makeConstant(OBJ_VAL(function)));
+    emitConstant(OBJ_VAL(function));
 
     consume(TOKEN_END, "Expect 'end' keyword after def block.");
 }
 
 static void funDeclaration()
 {
-    uint8_t global = parseVariable("Expect function name.");
+    int global = parseVariable("Expect function name.");
     markInitialized();
     function(TYPE_FUNCTION);
     defineVariable(global);
@@ -773,7 +1247,7 @@ static void varDeclaration()
 {
     do
     {
-        uint8_t global = parseVariable("Expect variable name.");
+        int global = parseVariable("Expect variable name.");
 
         if (match(TOKEN_EQUAL))
         {
@@ -821,9 +1295,63 @@ static void expressionStatement()
 {
     expression();
     consume(TOKEN_SEMICOLON, "Expect ';' after expression.");
+
+    // x = x + <number> as a statement becomes one in-place increment.
+    if (recentOp(0) == OP_SET_LOCAL && recentOp(1) == OP_ADD && recentOp(2) == OP_CONSTANT &&
+        recentOp(3) == OP_GET_LOCAL && recentOperand(0, 0) == recentOperand(3, 0) &&
+        IS_NUMBER(currentChunk()->constants.values[recentOperand(2, 0)]) && canFuse(4))
+    {
+        uint8_t slot = recentOperand(0, 0);
+        uint8_t constant = recentOperand(2, 0);
+        removeRecent(4);
+        emitByte(OP_INCR_LOCAL);
+        emitBytes(slot, constant);
+        return;
+    }
+
     emitByte(OP_POP);
 }
 
+// Emits the jump taken when the condition just compiled is false and returns
+// its offset. A trailing comparison is fused into the jump, which then pops
+// the operands itself; otherwise the condition stays on the stack and both
+// paths pop it, which `*needsPop` reports.
+static int emitConditionJump(bool *needsPop)
+{
+    static const struct
+    {
+        uint8_t compare;
+        uint8_t jumpIfFalse;
+        uint8_t jumpIfTrue;
+    } fusions[] = {
+        {OP_EQUAL, OP_JUMP_IF_NOT_EQUAL, OP_JUMP_IF_EQUAL},
+        {OP_GREATER, OP_JUMP_IF_NOT_GREATER, OP_JUMP_IF_GREATER},
+        {OP_LESS, OP_JUMP_IF_NOT_LESS, OP_JUMP_IF_LESS},
+    };
+
+    for (size_t i = 0; i < sizeof(fusions) / sizeof(fusions[0]); i++)
+    {
+        if (recentOp(0) == fusions[i].compare && canFuse(1))
+        {
+            removeRecent(1);
+            *needsPop = false;
+            return emitJump(fusions[i].jumpIfFalse);
+        }
+
+        if (recentOp(0) == OP_NOT && recentOp(1) == fusions[i].compare && canFuse(2))
+        {
+            removeRecent(2);
+            *needsPop = false;
+            return emitJump(fusions[i].jumpIfTrue);
+        }
+    }
+
+    int jump = emitJump(OP_JUMP_IF_FALSE);
+    emitByte(OP_POP);
+    *needsPop = true;
+    return jump;
+}
+
 static void ifStatement()
 {
     int exitJumps[UINT8_COUNT];
@@ -832,8 +1360,8 @@ static void ifStatement()
     expression();
     consume(TOKEN_COLON, "Expect ':' after if condition.");
 
-    int elseJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
+    bool needsPop;
+    int elseJump = emitConditionJump(&needsPop);
 
     while (!check(TOKEN_EOF) && !check(TOKEN_ELIF) && !check(TOKEN_ELSE) && !check(TOKEN_END))
     {
@@ -842,15 +1370,15 @@ static void ifStatement()
 
     int exitJump = emitJump(OP_JUMP);
     patchJump(elseJump);
-    emitByte(OP_POP);
+    if (needsPop)
+        emitByte(OP_POP);
 
     while (match(TOKEN_ELIF))
     {
         expression();
         consume(TOKEN_COLON, "Expect ':' after elif condition.");
 
-        int elifJump = emitJump(OP_JUMP_IF_FALSE);
-        emitByte(OP_POP);
+        int elifJump = emitConditionJump(&needsPop);
 
         while (!check(TOKEN_EOF) && !check(TOKEN_ELIF) && !check(TOKEN_ELSE) && !check(TOKEN_END))
         {
@@ -859,7 +1387,8 @@ static void ifStatement()
 
         int nextExitJump = emitJump(OP_JUMP);
         patchJump(elifJump);
-        emitByte(OP_POP);
+        if (needsPop)
+            emitByte(OP_POP);
 
         exitJumps[exitJumpIndex++] = exitJump;
         exitJump = nextExitJump;
@@ -907,6 +1436,11 @@ static void returnStatement()
     {
         expression();
         consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+
+        // A call in tail position can reuse the caller's frame. The OP_RETURN
+        // stays for paths that jump past the call, like `return a and f();`.
+        if (recentOp(0) == OP_CALL)
+            currentChunk()->code[current->recent[0]] = OP_TAIL_CALL;
         emitByte(OP_RETURN);
     }
 }
@@ -918,11 +1452,12 @@ static void whileStatement()
     int breakJumpIndex = 0;
 
     int loopStart = currentChunk()->count;
+    markJumpTarget(loopStart);
     expression();
     consume(TOKEN_COLON, "Expect ':' after condition.");
 
-    int exitJump = emitJump(OP_JUMP_IF_FALSE);
-    emitByte(OP_POP);
+    bool needsPop;
+    int exitJump = emitConditionJump(&needsPop);
 
     currentBreakJumps = breakJumps;
     currentBreakJumpIndex = &breakJumpIndex;
@@ -936,14 +1471,15 @@ static void whileStatement()
     emitLoop(loopStart);
 
     patchJump(exitJump);
+    if (needsPop)
+        emitByte(OP_POP);
 
+    // Breaks leave after the condition has been popped.
     while (breakJumpIndex--)
     {
         patchJump(breakJumps[breakJumpIndex]);
     }
 
-    emitByte(OP_POP);
-
     consume(TOKEN_END, "Expect 'end' keyword after while block.");
     loopDepth--;
 }
@@ -1050,3 +1586,13 @@ ObjFunction *compile(const char *source)
     ObjFunction *function = endCompiler();
     return parser.hadError ? NULL : function;
 }
+
+void markCompilerRoots()
+{
+    Compiler *compiler = current;
+    while (compiler != NULL)
+    {
+        markObject((Obj *)compiler->function);
+        compiler = compiler->enclosing;
+    }
+}
@@ -5,5 +5,6 @@
 #include "vm.h"
 
 ObjFunction *compile(const char *source);
+void markCompilerRoots();
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "debug.h"
 #include "value.h"
+#include "vm.h"
 
 void disassembleChunk(Chunk *chunk, const char *name)
 {
@@ -22,6 +23,44 @@ static int constantInstruction(const char *name, Chunk *chunk, int offset)
     return offset + 2;
 }
 
+static int globalInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint8_t slot = chunk->code[offset + 1];
+    printf("%-16s %4d '", name, slot);
+    printValue(vm.globalNames.values[slot]);
+    printf("'\n");
+    return offset + 2;
+}
+
+static int readLong(Chunk *chunk, int offset)
+{
+    return (chunk->code[offset] << 16) | (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+}
+
+static int constantLongInstruction(const char *name, Chunk *chunk, int offset)
+{
+    int constant = readLong(chunk, offset + 1);
+    printf("%-16s %4d '", name, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 4;
+}
+
+static int globalLongInstruction(const char *name, Chunk *chunk, int offset)
+{
+    int slot = readLong(chunk, offset + 1);
+    printf("%-16s %4d '", name, slot);
+    printValue(vm.globalNames.values[slot]);
+    printf("'\n");
+    return offset + 4;
+}
+
+static int longInstruction(const char *name, Chunk *chunk, int offset)
+{
+    printf("%-16s %4d\n", name, readLong(chunk, offset + 1));
+    return offset + 4;
+}
+
 static int simpleInstruction(const char *name, int offset)
 {
     printf("%s\n", name);
@@ -35,6 +74,24 @@ static int byteInstruction(const char *name, Chunk *chunk, int offset)
     return offset + 2;
 }
 
+static int twoByteInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint8_t first = chunk->code[offset + 1];
+    uint8_t second = chunk->code[offset + 2];
+    printf("%-16s %4d %4d\n", name, first, second);
+    return offset + 3;
+}
+
+static int localConstantInstruction(const char *name, Chunk *chunk, int offset)
+{
+    uint8_t slot = chunk->code[offset + 1];
+    uint8_t constant = chunk->code[offset + 2];
+    printf("%-16s %4d %4d '", name, slot, constant);
+    printValue(chunk->constants.values[constant]);
+    printf("'\n");
+    return offset + 3;
+}
+
 static int jumpInstruction(const char *name, int sign, Chunk *chunk, int offset)
 {
     uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
@@ -47,13 +104,14 @@ int disassembleInstruction(Chunk *chunk, int offset)
 {
     printf("%04d ", offset);
 
-    if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
+    int line = getLine(chunk, offset);
+    if (offset > 0 && line == getLine(chunk, offset - 1))
     {
         printf("   | ");
     }
     else
     {
-        printf("%4d ", chunk->lines[offset]);
+        printf("%4d ", line);
     }
 
     uint8_t instruction = chunk->code[offset];
@@ -74,15 +132,19 @@ int disassembleInstruction(Chunk *chunk, int offset)
     case OP_SET_LOCAL:
         return byteInstruction("OP_SET_LOCAL", chunk, offset);
     case OP_GET_GLOBAL:
-        return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+        return globalInstruction("OP_GET_GLOBAL", chunk, offset);
     case OP_DEFINE_GLOBAL:
-        return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+        return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
     case OP_SET_GLOBAL:
-        return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+        return globalInstruction("OP_SET_GLOBAL", chunk, offset);
     case OP_BUILD_LIST:
         return byteInstruction("OP_BUILD_LIST", chunk, offset);
+    case OP_BUILD_DICT:
+        return byteInstruction("OP_BUILD_DICT", chunk, offset);
     case OP_INDEX_SUBSCR:
         return simpleInstruction("OP_INDEX_SUBSCR", offset);
+    case OP_SLICE:
+        return simpleInstruction("OP_SLICE", offset);
     case OP_STORE_SUBSCR:
         return simpleInstruction("OP_STORE_SUBSCR", offset);
     case OP_EQUAL:
@@ -91,6 +153,8 @@ int disassembleInstruction(Chunk *chunk, int offset)
         return simpleInstruction("OP_GREATER", offset);
     case OP_LESS:
         return simpleInstruction("OP_LESS", offset);
+    case OP_IN:
+        return simpleInstruction("OP_IN", offset);
     case OP_ADD:
         return simpleInstruction("OP_ADD", offset);
     case OP_SUBTRACT:
@@ -117,8 +181,62 @@ int disassembleInstruction(Chunk *chunk, int offset)
         return jumpInstruction("OP_LOOP", -1, chunk, offset);
     case OP_CALL:
         return byteInstruction("OP_CALL", chunk, offset);
+    case OP_TAIL_CALL:
+        return byteInstruction("OP_TAIL_CALL", chunk, offset);
     case OP_RETURN:
         return simpleInstruction("OP_RETURN", offset);
+    case OP_CONSTANT_LONG:
+        return constantLongInstruction("OP_CONSTANT_LONG", chunk, offset);
+    case OP_GET_LOCAL_LONG:
+        return longInstruction("OP_GET_LOCAL_LONG", chunk, offset);
+    case OP_SET_LOCAL_LONG:
+        return longInstruction("OP_SET_LOCAL_LONG", chunk, offset);
+    case OP_GET_GLOBAL_LONG:
+        return globalLongInstruction("OP_GET_GLOBAL_LONG", chunk, offset);
+    case OP_DEFINE_GLOBAL_LONG:
+        return globalLongInstruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
+    case OP_SET_GLOBAL_LONG:
+        return globalLongInstruction("OP_SET_GLOBAL_LONG", chunk, offset);
+    case OP_BUILD_LIST_LONG:
+        return longInstruction("OP_BUILD_LIST_LONG", chunk, offset);
+    case OP_BUILD_DICT_LONG:
+        return longInstruction("OP_BUILD_DICT_LONG", chunk, offset);
+    case OP_JUMP_IF_NOT_EQUAL:
+        return jumpInstruction("OP_JUMP_IF_NOT_EQUAL", 1, chunk, offset);
+    case OP_JUMP_IF_EQUAL:
+        return jumpInstruction("OP_JUMP_IF_EQUAL", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER:
+        return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+    case OP_JUMP_IF_GREATER:
+        return jumpInstruction("OP_JUMP_IF_GREATER", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_LESS:
+        return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+    case OP_JUMP_IF_LESS:
+        return jumpInstruction("OP_JUMP_IF_LESS", 1, chunk, offset);
+    case OP_INCR_LOCAL:
+        return localConstantInstruction("OP_INCR_LOCAL", chunk, offset);
+    case OP_ADD_LOCALS:
+        return twoByteInstruction("OP_ADD_LOCALS", chunk, offset);
+    case OP_INDEX_SUBSCR2:
+        return simpleInstruction("OP_INDEX_SUBSCR2", offset);
+    case OP_ADD_INT:
+        return simpleInstruction("OP_ADD_INT", offset);
+    case OP_ADD_DOUBLE:
+        return simpleInstruction("OP_ADD_DOUBLE", offset);
+    case OP_MULTIPLY_INT:
+        return simpleInstruction("OP_MULTIPLY_INT", offset);
+    case OP_MULTIPLY_DOUBLE:
+        return simpleInstruction("OP_MULTIPLY_DOUBLE", offset);
+    case OP_INDEX_LIST_INT:
+        return simpleInstruction("OP_INDEX_LIST_INT", offset);
+    case OP_INDEX2_LIST_INT:
+        return simpleInstruction("OP_INDEX2_LIST_INT", offset);
+    case OP_STORE_LIST_INT:
+        return simpleInstruction("OP_STORE_LIST_INT", offset);
+    case OP_INDEX_BITSET_INT:
+        return simpleInstruction("OP_INDEX_BITSET_INT", offset);
+    case OP_STORE_BITSET_INT:
+        return simpleInstruction("OP_STORE_BITSET_INT", offset);
     default:
         printf("Unknown opcode %d\n", instruction);
         return offset + 1;
@@ -0,0 +1,241 @@
+#include <string.h>
+
+#include "dict.h"
+#include "memory.h"
+#include "profile.h"
+#include "table.h"
+#include "vm.h"
+
+// ObjDict is probed exactly like Table, by groups of control bytes, but its
+// keys are Values and are compared with valuesEqual(). Keys must be hashable:
+// numbers, strings, bools, none and functions. Lists, builders, dicts and
+// bitsets can change, so they cannot be keys. Callers check isHashable() first.
+
+static uint32_t hashBits(uint64_t bits)
+{
+    bits *= 0x9e3779b97f4a7c15u;
+    return (uint32_t)(bits ^ (bits >> 32));
+}
+
+bool isHashable(Value value)
+{
+    return !IS_OBJ(value) || IS_STRING(value) || IS_FUNCTION(value) || IS_NATIVE(value);
+}
+
+// Values that are equal must hash alike, so a whole double hashes as the
+// integer it equals.
+static uint32_t hashValue(Value value)
+{
+    if (IS_INT(value))
+        return hashBits((uint64_t)AS_INT(value));
+    if (IS_DOUBLE(value))
+    {
+        double number = AS_DOUBLE(value);
+        if (number >= -9.2e18 && number <= 9.2e18 && number == (double)(int64_t)number)
+            return hashBits((uint64_t)(int64_t)number);
+
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        return hashBits(bits);
+    }
+    if (IS_STRING(value))
+        return stringHash(AS_STRING(value));
+    if (IS_OBJ(value))
+        return hashBits((uint64_t)(uintptr_t)AS_OBJ(value));
+    if (IS_BOOL(value))
+        return AS_BOOL(value) ? 0x7b1d5a3u : 0x2c9e481u;
+    return 0x51f3c6eu;
+}
+
+// Returns the slot holding the key, or -1. The dict must not be empty.
+static int findSlot(ObjDict *dict, Value key, uint32_t hash)
+{
+    int group = FIRST_GROUP(dict->capacity, hash);
+    for (int step = 1;; step++)
+    {
+        const uint8_t *control = dict->control + group * TABLE_GROUP_SIZE;
+        for (uint32_t mask = matchByte(control, FRAGMENT(hash)); mask != 0; mask &= mask - 1)
+        {
+            int slot = group * TABLE_GROUP_SIZE + __builtin_ctz(mask);
+            if (valuesEqual(dict->entries[slot].key, key))
+                return slot;
+        }
+
+        if (matchByte(control, CONTROL_EMPTY) != 0)
+            return -1;
+        group = NEXT_GROUP(dict->capacity, group, step);
+    }
+}
+
+static void insertEntry(ObjDict *dict, Value key, Value value, uint32_t hash)
+{
+    int group = FIRST_GROUP(dict->capacity, hash);
+    uint32_t mask;
+    for (int step = 1; (mask = matchFree(dict->control + group * TABLE_GROUP_SIZE)) == 0; step++)
+        group = NEXT_GROUP(dict->capacity, group, step);
+
+    int slot = group * TABLE_GROUP_SIZE + __builtin_ctz(mask);
+    if (dict->control[slot] == CONTROL_DELETED)
+        dict->tombstones--;
+
+    dict->control[slot] = FRAGMENT(hash);
+    dict->entries[slot].key = key;
+    dict->entries[slot].value = value;
+    dict->count++;
+}
+
+// The dict must be reachable, since this can collect.
+static void adjustCapacity(ObjDict *dict, int capacity)
+{
+    if (heapProfiling)
+        profileObject(OBJ_DICT);
+    uint8_t *control = ALLOCATE(uint8_t, capacity);
+    if (heapProfiling)
+        profileObject(OBJ_DICT);
+    DictEntry *entries = ALLOCATE(DictEntry, capacity);
+
+    memset(control, CONTROL_EMPTY, capacity);
+    for (int i = 0; i < capacity; i++)
+    {
+        entries[i].key = UNDEFINED_VAL;
+        entries[i].value = NONE_VAL;
+    }
+
+    uint8_t *oldControl = dict->control;
+    DictEntry *oldEntries = dict->entries;
+    int oldCapacity = dict->capacity;
+
+    dict->count = 0;
+    dict->tombstones = 0;
+    dict->capacity = capacity;
+    dict->control = control;
+    dict->entries = entries;
+    for (int i = 0; i < oldCapacity; i++)
+    {
+        DictEntry *entry = &oldEntries[i];
+        if (!IS_UNDEFINED(entry->key))
+            insertEntry(dict, entry->key, entry->value, hashValue(entry->key));
+    }
+
+    FREE_ARRAY(uint8_t, oldControl, oldCapacity);
+    FREE_ARRAY(DictEntry, oldEntries, oldCapacity);
+}
+
+// Sizes the dict so `count` keys fit without growing it again.
+void reserveDict(ObjDict *dict, int count)
+{
+    int capacity = dict->capacity < TABLE_GROUP_SIZE ? TABLE_GROUP_SIZE : dict->capacity;
+    while (count > TABLE_MAX_LOAD(capacity))
+        capacity *= 2;
+
+    if (capacity > dict->capacity)
+        adjustCapacity(dict, capacity);
+}
+
+bool dictGet(ObjDict *dict, Value key, Value *value)
+{
+    if (dict->count == 0)
+        return false;
+
+    int slot = findSlot(dict, key, hashValue(key));
+    if (slot < 0)
+        return false;
+
+    *value = dict->entries[slot].value;
+    return true;
+}
+
+// Returns true if the key is new. The dict, key and value must be reachable,
+// since growing the dict can collect.
+bool dictSet(ObjDict *dict, Value key, Value value)
+{
+    uint32_t hash = hashValue(key);
+    int slot = dict->count > 0 ? findSlot(dict, key, hash) : -1;
+    if (slot >= 0)
+    {
+        dict->entries[slot].value = value;
+        writeBarrier((Obj *)dict, value);
+        return false;
+    }
+
+    if (dict->count + dict->tombstones + 1 > TABLE_MAX_LOAD(dict->capacity))
+    {
+        // A dict that is mostly tombstones is rebuilt at the same size.
+        int capacity = dict->capacity;
+        if (dict->count + 1 > TABLE_MAX_LOAD(capacity) / 2)
+            capacity = capacity < TABLE_GROUP_SIZE ? TABLE_GROUP_SIZE : capacity * 2;
+        adjustCapacity(dict, capacity);
+    }
+
+    insertEntry(dict, key, value, hash);
+    writeBarrier((Obj *)dict, key);
+    writeBarrier((Obj *)dict, value);
+    return true;
+}
+
+bool dictDelete(ObjDict *dict, Value key)
+{
+    if (dict->count == 0)
+        return false;
+
+    int slot = findSlot(dict, key, hashValue(key));
+    if (slot < 0)
+        return false;
+
+    // As in tableDelete(), a group that still has an empty slot needs no
+    // tombstone.
+    const uint8_t *group = dict->control + slot / TABLE_GROUP_SIZE * TABLE_GROUP_SIZE;
+    if (matchByte(group, CONTROL_EMPTY) != 0)
+    {
+        dict->control[slot] = CONTROL_EMPTY;
+    }
+    else
+    {
+        dict->control[slot] = CONTROL_DELETED;
+        dict->tombstones++;
+    }
+
+    dict->entries[slot].key = UNDEFINED_VAL;
+    dict->entries[slot].value = NONE_VAL;
+    dict->count--;
+    return true;
+}
+
+// Copies the keys or the values into a new list of exactly the right size, in
+// slot order.
+static ObjList *collectEntries(ObjDict *dict, bool keys)
+{
+    ObjList *list = newList();
+    if (dict->count == 0)
+        return list;
+
+    push(OBJ_VAL(list));
+    if (heapProfiling)
+        profileObject(OBJ_LIST);
+    list->items = ALLOCATE(Value, dict->count);
+    list->capacity = dict->count;
+    pop();
+
+    // The allocation may have promoted the list, and marked it too, so each
+    // item goes through the write barrier.
+    for (int i = 0; i < dict->capacity; i++)
+    {
+        DictEntry *entry = &dict->entries[i];
+        if (IS_UNDEFINED(entry->key))
+            continue;
+
+        list->items[list->count] = keys ? entry->key : entry->value;
+        writeBarrier((Obj *)list, list->items[list->count++]);
+    }
+    return list;
+}
+
+ObjList *dictKeys(ObjDict *dict)
+{
+    return collectEntries(dict, true);
+}
+
+ObjList *dictValues(ObjDict *dict)
+{
+    return collectEntries(dict, false);
+}
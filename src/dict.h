@@ -0,0 +1,16 @@
+#ifndef purr_dict_h
+#define purr_dict_h
+
+#include "common.h"
+#include "object.h"
+#include "value.h"
+
+bool isHashable(Value value);
+void reserveDict(ObjDict *dict, int count);
+bool dictGet(ObjDict *dict, Value key, Value *value);
+bool dictSet(ObjDict *dict, Value key, Value value);
+bool dictDelete(ObjDict *dict, Value key);
+ObjList *dictKeys(ObjDict *dict);
+ObjList *dictValues(ObjDict *dict);
+
+#endif
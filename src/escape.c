@@ -1,25 +1,18 @@
 #include "escape.h"
 
 #include <ctype.h>
-#include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
-char *convert_string(const char *raw)
+// Decodes the escape sequences in the first `raw_len` bytes of `raw` into
+// `converted`, which must have room for `raw_len` bytes, and returns the
+// decoded length. Unknown escapes are kept as written.
+int convert_string(const char *raw, int raw_len, char *converted)
 {
-    size_t raw_len = strlen(raw);
-    size_t converted_len = 0;
+    int converted_len = 0;
 
-    char *converted = malloc((raw_len + 1) * sizeof(char));
-    if (converted == NULL)
+    for (int i = 0; i < raw_len; i++)
     {
-        fprintf(stderr, "Memory allocation failed.\n");
-        return NULL;
-    }
-
-    for (size_t i = 0; i < raw_len; i++)
-    {
-        if (raw[i] == '\\' && i < raw_len - 1)
+        if (raw[i] == '\\' && i + 1 < raw_len)
         {
             switch (raw[i + 1])
             {
@@ -60,7 +53,7 @@ char *convert_string(const char *raw)
                 i++;
                 break;
             case '0':
-                if (i < raw_len - 3 && raw[i + 2] >= '0' && raw[i + 2] <= '7' && raw[i + 3] >= '0' && raw[i + 3] <= '7')
+                if (i + 3 < raw_len && raw[i + 2] >= '0' && raw[i + 2] <= '7' && raw[i + 3] >= '0' && raw[i + 3] <= '7')
                 {
                     char octal[4] = {raw[i + 1], raw[i + 2], raw[i + 3], '\0'};
                     converted[converted_len++] = strtol(octal, NULL, 8);
@@ -72,7 +65,7 @@ char *convert_string(const char *raw)
                 }
                 break;
             case 'x':
-                if (i < raw_len - 3 && isxdigit(raw[i + 2]) && isxdigit(raw[i + 3]))
+                if (i + 3 < raw_len && isxdigit((unsigned char)raw[i + 2]) && isxdigit((unsigned char)raw[i + 3]))
                 {
                     char hex[3] = {raw[i + 2], raw[i + 3], '\0'};
                     converted[converted_len++] = strtol(hex, NULL, 16);
@@ -94,6 +87,5 @@ char *convert_string(const char *raw)
         }
     }
 
-    converted[converted_len] = '\0';
-    return converted;
+    return converted_len;
 }
\ No newline at end of file
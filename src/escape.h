@@ -1,6 +1,6 @@
 #ifndef purr_escape_h
 #define purr_escape_h
 
-char *convert_string(const char *raw);
+int convert_string(const char *raw, int raw_len, char *converted);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "hash.h"
+
+// A wyhash-style string hash. It reads eight bytes at a time and mixes them
+// with a 64x64->128-bit multiply, so it is several times faster than
+// byte-at-a-time FNV-1a on anything but the shortest keys, and every input
+// bit reaches every output bit.
+
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+#define WY_P3 0x589965cc75374cc3ull
+
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+    uint64_t aHigh = a >> 32, aLow = (uint32_t)a, bHigh = b >> 32, bLow = (uint32_t)b;
+    uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow, middle1 = aLow * bHigh, low = aLow * bLow;
+    uint64_t carry = (low >> 32) + (uint32_t)middle0 + (uint32_t)middle1;
+    uint64_t productLow = (carry << 32) | (uint32_t)low;
+    uint64_t productHigh = high + (middle0 >> 32) + (middle1 >> 32) + (carry >> 32);
+    return productLow ^ productHigh;
+#endif
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hashString(const char *key, int length)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint64_t seed = WY_P0 ^ mix(WY_P0, WY_P1);
+    uint64_t a, b;
+
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            // Two overlapping reads from each end cover 4 to 16 bytes.
+            int offset = (length >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + offset);
+            b = (read32(p + length - 4) << 32) | read32(p + length - 4 - offset);
+        }
+        else if (length > 0)
+        {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        }
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        int remaining = length;
+        if (remaining > 48)
+        {
+            // Three independent lanes keep the multiplier busy on long strings.
+            uint64_t seed1 = seed, seed2 = seed;
+            do
+            {
+                seed = mix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ WY_P2, read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ WY_P3, read64(p + 40) ^ seed2);
+                p += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (remaining > 16)
+        {
+            seed = mix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
+    }
+
+    uint64_t hash = mix(WY_P1 ^ (uint64_t)length, mix(a ^ WY_P1, b ^ seed));
+    return (uint32_t)(hash ^ (hash >> 32));
+}
@@ -0,0 +1,8 @@
+#ifndef purr_hash_h
+#define purr_hash_h
+
+#include "common.h"
+
+uint32_t hashString(const char *key, int length);
+
+#endif
@@ -5,6 +5,7 @@
 #include "chunk.h"
 #include "common.h"
 #include "debug.h"
+#include "profile.h"
 #include "vm.h"
 
 static void repl()
@@ -63,6 +64,9 @@ static void runFile(const char *path)
     InterpretResult result = interpret(source);
     free(source);
 
+    if (heapProfiling)
+        printHeapProfile(stderr);
+
     if (result == INTERPRET_COMPILE_ERROR)
         exit(65);
     if (result == INTERPRET_RUNTIME_ERROR)
@@ -71,19 +75,28 @@ static void runFile(const char *path)
 
 int main(int argc, const char *argv[])
 {
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--heap-profile") == 0)
+    {
+        heapProfiling = true;
+        arg++;
+    }
+
     initVM();
 
-    if (argc == 1)
+    if (argc == arg)
     {
         repl();
+        if (heapProfiling)
+            printHeapProfile(stderr);
     }
-    else if (argc == 2)
+    else if (argc == arg + 1)
     {
-        runFile(argv[1]);
+        runFile(argv[arg]);
     }
     else
     {
-        fprintf(stderr, "Usage: purr [path]\n");
+        fprintf(stderr, "Usage: purr [--heap-profile] [path]\n");
         exit(64);
     }
 
@@ -1,24 +1,177 @@
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "compiler.h"
 #include "memory.h"
+#include "profile.h"
+#include "slab.h"
 #include "vm.h"
 
+#ifdef DEBUG_LOG_GC
+#include <stdio.h>
+#endif
+
+#define GC_HEAP_GROW_FACTOR 2
+
+// Objects start out young, on vm.objects. A young collection traces only young
+// objects, from the roots and from old objects a write barrier remembered, then
+// frees the dead ones and promotes the rest to vm.oldObjects. Once the old
+// generation outgrows vm.nextGC it is marked and swept incrementally, at most
+// GC_STEP_SIZE objects per young collection. The isMarked bit belongs to the
+// young collector on young objects and to the old one on old objects.
+//
+// String views hold their parent weakly. Before a parent found dead is freed,
+// every view that survives it is given a copy of its characters.
+
 void *reallocate(void *pointer, size_t oldSize, size_t newSize)
 {
+    vm.bytesAllocated += newSize - oldSize;
+    if (newSize > oldSize)
+    {
+        if (heapProfiling)
+            profileAllocation(newSize - oldSize);
+
+#ifdef DEBUG_STRESS_GC
+        collectGarbage();
+#else
+        if (vm.bytesAllocated > vm.nurseryLimit)
+            collectGarbage();
+#endif
+    }
+
     if (newSize == 0)
     {
-        free(pointer);
+        slabFree(pointer, oldSize);
         return NULL;
     }
 
-    void *result = realloc(pointer, newSize);
+    void *result = slabRealloc(pointer, oldSize, newSize);
     if (result == NULL)
         exit(1);
     return result;
 }
 
+// The collector's own stacks bypass reallocate() so they never trigger it.
+static void pushObject(ObjStack *stack, Obj *object)
+{
+    if (stack->capacity < stack->count + 1)
+    {
+        stack->capacity = GROW_CAPACITY(stack->capacity);
+        stack->objects = (Obj **)realloc(stack->objects, sizeof(Obj *) * stack->capacity);
+        if (stack->objects == NULL)
+            exit(1);
+    }
+
+    stack->objects[stack->count++] = object;
+}
+
+void markObject(Obj *object)
+{
+    // Each collector only marks its own generation.
+    if (object == NULL || object->isMarked || object->isOld != !vm.collectingYoung)
+        return;
+
+#ifdef DEBUG_LOG_GC
+    printf("%p mark ", (void *)object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+#endif
+
+    object->isMarked = true;
+    pushObject(vm.collectingYoung ? &vm.youngGray : &vm.oldGray, object);
+}
+
+void markValue(Value value)
+{
+    if (IS_OBJ(value))
+        markObject(AS_OBJ(value));
+}
+
+static void markArray(ValueArray *array)
+{
+    for (int i = 0; i < array->count; i++)
+    {
+        markValue(array->values[i]);
+    }
+}
+
+void writeBarrierSlow(Obj *owner, Obj *target)
+{
+    if (!target->isOld)
+    {
+        // An old object now points into the nursery, so the next young
+        // collection has to scan it.
+        if (!owner->isRemembered)
+        {
+            owner->isRemembered = true;
+            pushObject(&vm.remembered, owner);
+        }
+    }
+    else if (vm.gcPhase == GC_MARK && owner->isMarked && !target->isMarked)
+    {
+        // The owner may already be traced; shade the target so the running
+        // old-generation mark cannot miss it.
+        vm.collectingYoung = false;
+        markObject(target);
+    }
+}
+
+void keepInterned(ObjString *string)
+{
+    // A string the sweep has not reached yet may be dead. Marking it keeps it
+    // alive now that it has been handed out again.
+    if (vm.gcPhase == GC_SWEEP && string->obj.isOld)
+        string->obj.isMarked = true;
+}
+
+static void blackenObject(Obj *object)
+{
+#ifdef DEBUG_LOG_GC
+    printf("%p blacken ", (void *)object);
+    printValue(OBJ_VAL(object));
+    printf("\n");
+#endif
+
+    switch (object->type)
+    {
+    case OBJ_FUNCTION: {
+        ObjFunction *function = (ObjFunction *)object;
+        markObject((Obj *)function->name);
+        markArray(&function->chunk.constants);
+        break;
+    }
+    case OBJ_LIST: {
+        ObjList *list = (ObjList *)object;
+        for (int i = 0; i < list->count; i++)
+        {
+            markValue(list->items[i]);
+        }
+        break;
+    }
+    case OBJ_DICT: {
+        ObjDict *dict = (ObjDict *)object;
+        for (int i = 0; i < dict->capacity; i++)
+        {
+            markValue(dict->entries[i].key);
+            markValue(dict->entries[i].value);
+        }
+        break;
+    }
+    case OBJ_NATIVE:
+    case OBJ_STRING:
+    case OBJ_BUILDER:
+    case OBJ_BITSET:
+        break;
+    }
+}
+
 static void freeObject(Obj *object)
 {
+#ifdef DEBUG_LOG_GC
+    printf("%p free type %d\n", (void *)object, object->type);
+#endif
+
     switch (object->type)
     {
     case OBJ_FUNCTION: {
@@ -32,22 +185,258 @@ static void freeObject(Obj *object)
         break;
     case OBJ_STRING: {
         ObjString *string = (ObjString *)object;
-        FREE_ARRAY(char, string->chars, string->length + 1);
+        // The intern table and the tiny-string cache hold strings weakly.
+        if (string->isInterned)
+            tableDelete(&vm.strings, string);
+        forgetTinyString(string);
+        if (string->parent == NULL)
+            FREE_ARRAY(char, string->chars, string->length + 1);
         FREE(ObjString, object);
         break;
     }
     case OBJ_LIST: {
         ObjList *list = (ObjList *)object;
-        FREE_ARRAY(Value *, list->items, list->count);
+        FREE_ARRAY(Value, list->items, list->capacity);
         FREE(ObjList, object);
         break;
     }
+    case OBJ_BUILDER: {
+        ObjBuilder *builder = (ObjBuilder *)object;
+        FREE_ARRAY(char, builder->chars, builder->capacity);
+        FREE(ObjBuilder, object);
+        break;
+    }
+    case OBJ_DICT: {
+        ObjDict *dict = (ObjDict *)object;
+        FREE_ARRAY(uint8_t, dict->control, dict->capacity);
+        FREE_ARRAY(DictEntry, dict->entries, dict->capacity);
+        FREE(ObjDict, object);
+        break;
+    }
+    case OBJ_BITSET: {
+        ObjBitset *bitset = (ObjBitset *)object;
+        FREE_ARRAY(uint64_t, bitset->words, BITSET_WORDS(bitset->length));
+        FREE(ObjBitset, object);
+        break;
+    }
     }
 }
 
-void freeObjects()
+// Gives a view its own characters. It runs mid-collection, so it allocates
+// without going through reallocate().
+static void detachView(ObjString *view)
+{
+    char *chars = (char *)slabRealloc(NULL, 0, view->length + 1);
+    if (chars == NULL)
+        exit(1);
+    vm.bytesAllocated += view->length + 1;
+
+    memcpy(chars, view->chars, view->length);
+    chars[view->length] = '\0';
+    view->chars = chars;
+    view->parent = NULL;
+}
+
+// Called on a young view about to be promoted. A view is allocated after its
+// parent, so it comes first on vm.objects and a dead young parent is not freed
+// yet. An old parent is left for the old collector to judge.
+static void promoteView(ObjString *view)
+{
+    if (view->parent->obj.isOld || view->parent->obj.isMarked)
+        pushObject(&vm.views, (Obj *)view);
+    else
+        detachView(view);
+}
+
+// Runs once old marking is complete, when every view is old. Views that are
+// dead themselves are dropped from the list and left to the sweep.
+static void checkViews()
 {
+    int count = 0;
+    for (int i = 0; i < vm.views.count; i++)
+    {
+        ObjString *view = (ObjString *)vm.views.objects[i];
+        if (!view->obj.isMarked)
+            continue;
+
+        if (view->parent->obj.isMarked)
+            vm.views.objects[count++] = (Obj *)view;
+        else
+            detachView(view);
+    }
+    vm.views.count = count;
+}
+
+static void markRoots()
+{
+    for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
+    {
+        markValue(*slot);
+    }
+
+    for (int i = 0; i < vm.frameCount; i++)
+    {
+        markObject((Obj *)vm.frames[i].function);
+    }
+
+    for (int i = 0; i < UINT8_COUNT; i++)
+    {
+        markObject((Obj *)vm.charStrings[i]);
+    }
+
+    markTable(&vm.globalSlots);
+    markArray(&vm.globalNames);
+    markArray(&vm.globalValues);
+    markCompilerRoots();
+}
+
+static void collectYoung()
+{
+    vm.collectingYoung = true;
+    markRoots();
+
+    for (int i = 0; i < vm.remembered.count; i++)
+    {
+        Obj *object = vm.remembered.objects[i];
+        object->isRemembered = false;
+        blackenObject(object);
+    }
+    vm.remembered.count = 0;
+
+    while (vm.youngGray.count > 0)
+    {
+        blackenObject(vm.youngGray.objects[--vm.youngGray.count]);
+    }
+
     Obj *object = vm.objects;
+    while (object != NULL)
+    {
+        Obj *next = object->next;
+        if (object->isMarked)
+        {
+            if (object->type == OBJ_STRING && ((ObjString *)object)->parent != NULL)
+                promoteView((ObjString *)object);
+
+            // Survivors promoted while the old generation is being marked
+            // start gray, so whatever they point to is traced too.
+            object->isOld = true;
+            object->isMarked = vm.gcPhase == GC_MARK;
+            if (object->isMarked)
+                pushObject(&vm.oldGray, object);
+
+            object->next = vm.oldObjects;
+            vm.oldObjects = object;
+        }
+        else
+        {
+            freeObject(object);
+        }
+        object = next;
+    }
+    vm.objects = NULL;
+    vm.collectingYoung = false;
+}
+
+// Traces up to `budget` old objects and returns how much was left over.
+static int traceOld(int budget)
+{
+    vm.collectingYoung = false;
+    while (vm.oldGray.count > 0 && budget > 0)
+    {
+        blackenObject(vm.oldGray.objects[--vm.oldGray.count]);
+        budget--;
+    }
+    return budget;
+}
+
+// Frees up to `budget` unmarked old objects that were old when the sweep
+// began. Objects promoted since then sit on vm.oldObjects and are left alone.
+static int sweepOld(int budget)
+{
+    while (vm.sweepObjects != NULL && budget > 0)
+    {
+        Obj *object = vm.sweepObjects;
+        vm.sweepObjects = object->next;
+
+        if (object->isMarked)
+        {
+            object->isMarked = false;
+            object->next = vm.oldObjects;
+            vm.oldObjects = object;
+        }
+        else
+        {
+            freeObject(object);
+        }
+        budget--;
+    }
+    return budget;
+}
+
+// Advances the old-generation cycle by one bounded step. It only runs right
+// after a young collection, when the nursery is empty.
+static void stepOld(int budget)
+{
+    switch (vm.gcPhase)
+    {
+    case GC_IDLE:
+        if (vm.bytesAllocated <= vm.nextGC)
+            return;
+        vm.gcPhase = GC_MARK;
+        vm.collectingYoung = false;
+        markRoots();
+        break;
+    case GC_MARK:
+        if (traceOld(budget) == 0)
+            return;
+
+        // Roots are not behind the write barrier, so scan them again and
+        // finish marking atomically.
+        markRoots();
+        traceOld(INT_MAX);
+        checkViews();
+
+        vm.gcPhase = GC_SWEEP;
+        vm.sweepObjects = vm.oldObjects;
+        vm.oldObjects = NULL;
+        break;
+    case GC_SWEEP:
+        if (sweepOld(budget) == 0)
+            return;
+
+        vm.gcPhase = GC_IDLE;
+        vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+        if (vm.nextGC < GC_MIN_HEAP)
+            vm.nextGC = GC_MIN_HEAP;
+        break;
+    }
+}
+
+void collectGarbage()
+{
+#ifdef DEBUG_LOG_GC
+    printf("-- gc begin\n");
+    size_t before = vm.bytesAllocated;
+#endif
+
+    collectYoung();
+
+    // Fall behind too far and the old generation is finished in one go
+    // rather than letting the heap run away.
+    int budget = vm.bytesAllocated > vm.nextGC * GC_HEAP_GROW_FACTOR ? INT_MAX : GC_STEP_SIZE;
+    stepOld(budget);
+
+    vm.nurseryLimit = vm.bytesAllocated + GC_NURSERY_SIZE;
+
+#ifdef DEBUG_LOG_GC
+    printf("-- gc end\n");
+    printf("   collected %zu bytes (from %zu to %zu) phase %d\n", before - vm.bytesAllocated, before, vm.bytesAllocated,
+           vm.gcPhase);
+#endif
+}
+
+static void freeList(Obj *object)
+{
     while (object != NULL)
     {
         Obj *next = object->next;
@@ -55,3 +444,15 @@ void freeObjects()
         object = next;
     }
 }
+
+void freeObjects()
+{
+    freeList(vm.objects);
+    freeList(vm.oldObjects);
+    freeList(vm.sweepObjects);
+
+    free(vm.youngGray.objects);
+    free(vm.oldGray.objects);
+    free(vm.remembered.objects);
+    free(vm.views.objects);
+}
@@ -8,6 +8,22 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+// The heap size the first collection waits for, and the least the next
+// threshold is ever set to.
+#ifndef GC_MIN_HEAP
+#define GC_MIN_HEAP (1024 * 1024)
+#endif
+
+// Bytes allocated between young collections, and the most old objects traced or
+// swept after each one. Together they bound a pause. Override with -D.
+#ifndef GC_NURSERY_SIZE
+#define GC_NURSERY_SIZE (256 * 1024)
+#endif
+
+#ifndef GC_STEP_SIZE
+#define GC_STEP_SIZE 1024
+#endif
+
 #define GROW_CAPACITY(capacity) ((capacity) < 8 ? 8 : (capacity)*2)
 
 #define GROW_ARRAY(type, pointer, oldCount, newCount)                                                                  \
@@ -16,6 +32,19 @@
 #define FREE_ARRAY(type, pointer, oldCount) reallocate(pointer, sizeof(type) * (oldCount), 0)
 
 void *reallocate(void *pointer, size_t oldSize, size_t newSize);
+void markObject(Obj *object);
+void markValue(Value value);
+void writeBarrierSlow(Obj *owner, Obj *target);
+void keepInterned(ObjString *string);
+void collectGarbage();
 void freeObjects();
 
+// Must be called whenever a reference is stored into a heap object. Only stores
+// into old objects need any work.
+static inline void writeBarrier(Obj *owner, Value value)
+{
+    if (IS_OBJ(value) && owner->isOld)
+        writeBarrierSlow(owner, AS_OBJ(value));
+}
+
 #endif
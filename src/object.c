@@ -2,9 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "escape.h"
 #include "memory.h"
 #include "object.h"
+#include "profile.h"
 #include "table.h"
 #include "value.h"
 #include "vm.h"
@@ -13,10 +13,21 @@
 
 static Obj *allocateObject(size_t size, ObjType type)
 {
+    if (heapProfiling)
+        profileObject(type);
+
     Obj *object = (Obj *)reallocate(NULL, 0, size);
     object->type = type;
+    object->isMarked = false;
+    object->isOld = false;
+    object->isRemembered = false;
     object->next = vm.objects;
     vm.objects = object;
+
+#ifdef DEBUG_LOG_GC
+    printf("%p allocate %zu for %d\n", (void *)object, size, type);
+#endif
+
     return object;
 }
 
@@ -24,6 +35,7 @@ ObjFunction *newFunction()
 {
     ObjFunction *function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
     function->arity = 0;
+    function->stackSize = 0;
     function->name = NULL;
     initChunk(&function->chunk);
     return function;
@@ -36,51 +48,170 @@ ObjNative *newNative(NativeFn function)
     return native;
 }
 
-static ObjString *allocateString(char *chars, int length, uint32_t hash)
+static ObjString *allocateString(char *chars, int length)
 {
     ObjString *string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
     string->length = length;
     string->chars = chars;
+    string->parent = NULL;
+    string->hash = 0;
+    string->hasHash = false;
+    string->isInterned = false;
+    return string;
+}
+
+static ObjString *internString(char *chars, int length, uint32_t hash)
+{
+    ObjString *string = allocateString(chars, length);
     string->hash = hash;
+    string->hasHash = true;
+    string->isInterned = true;
+
+    // Growing the intern table can collect, and the string is not rooted yet.
+    push(OBJ_VAL(string));
     tableSet(&vm.strings, string, NONE_VAL);
+    pop();
     return string;
 }
 
-static uint32_t hashString(const char *key, int length)
+// Single bytes index vm.charStrings directly; other tiny strings are keyed by
+// their packed bytes, which is much cheaper than hashing and probing.
+static uint32_t tinySlot(const char *chars, int length)
 {
-    uint32_t hash = 2166136261u;
-    for (int i = 0; i < length; i++)
-    {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
-    }
-    return hash;
+    uint64_t word = 0;
+    memcpy(&word, chars, length);
+    return (uint32_t)(((word ^ (uint64_t)length) * 0x9e3779b97f4a7c15u) >> (64 - TINY_CACHE_BITS));
+}
+
+static ObjString *findTinyString(const char *chars, int length)
+{
+    if (length == 1)
+        return vm.charStrings[(uint8_t)chars[0]];
+    if (length > TINY_STRING_MAX)
+        return NULL;
+
+    ObjString *string = vm.tinyStrings[tinySlot(chars, length)];
+    if (string == NULL || string->length != length || memcmp(string->chars, chars, length) != 0)
+        return NULL;
+
+    keepInterned(string);
+    return string;
+}
+
+static ObjString *rememberTinyString(ObjString *string)
+{
+    if (string->length <= TINY_STRING_MAX && string->length != 1)
+        vm.tinyStrings[tinySlot(string->chars, string->length)] = string;
+    return string;
+}
+
+// The cache does not keep strings alive, so a collected one must leave it.
+void forgetTinyString(ObjString *string)
+{
+    if (string->length > TINY_STRING_MAX || string->length == 1)
+        return;
+
+    uint32_t slot = tinySlot(string->chars, string->length);
+    if (vm.tinyStrings[slot] == string)
+        vm.tinyStrings[slot] = NULL;
 }
 
+// Takes ownership of a buffer built at runtime. Such strings are usually
+// transient, so they are not hashed or interned; equality compares contents.
 ObjString *takeString(char *chars, int length)
 {
-    uint32_t hash = hashString(chars, length);
-    ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
-    if (interned != NULL)
+    ObjString *tiny = findTinyString(chars, length);
+    if (tiny != NULL)
     {
         FREE_ARRAY(char, chars, length + 1);
-        return interned;
+        return tiny;
+    }
+
+    return rememberTinyString(allocateString(chars, length));
+}
+
+// Like takeString(), for characters the caller keeps.
+ObjString *newString(const char *chars, int length)
+{
+    ObjString *tiny = findTinyString(chars, length);
+    if (tiny != NULL)
+        return tiny;
+
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
+    char *heapChars = ALLOCATE(char, length + 1);
+    memcpy(heapChars, chars, length);
+    heapChars[length] = '\0';
+    return rememberTinyString(allocateString(heapChars, length));
+}
+
+// Returns the characters in [start, end). Slices too long for the tiny-string
+// cache are views that share the characters they were cut from.
+ObjString *sliceString(ObjString *string, int start, int end)
+{
+    int length = end > start ? end - start : 0;
+    if (length == string->length)
+        return string;
+
+    ObjString *tiny = findTinyString(string->chars + start, length);
+    if (tiny != NULL)
+        return tiny;
+
+    if (length <= TINY_STRING_MAX)
+    {
+        if (heapProfiling)
+            profileObject(OBJ_STRING);
+        char *chars = ALLOCATE(char, length + 1);
+        // Read the source only now, in case the allocation moved it.
+        memcpy(chars, string->chars + start, length);
+        chars[length] = '\0';
+        return rememberTinyString(allocateString(chars, length));
     }
 
-    return allocateString(chars, length, hash);
+    ObjString *view = allocateString(NULL, length);
+    view->parent = string->parent != NULL ? string->parent : string;
+    view->chars = string->chars + start;
+    return view;
 }
 
+// Interns the string, so equal copyString() results are the same object. The
+// compiler relies on that for identifiers and constants.
 ObjString *copyString(const char *chars, int length)
 {
+    ObjString *tiny = findTinyString(chars, length);
+    if (tiny != NULL && tiny->isInterned)
+        return tiny;
+
     uint32_t hash = hashString(chars, length);
     ObjString *interned = tableFindString(&vm.strings, chars, length, hash);
     if (interned != NULL)
-        return interned;
+    {
+        keepInterned(interned);
+        return rememberTinyString(interned);
+    }
 
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
     char *heapChars = ALLOCATE(char, length + 1);
     memcpy(heapChars, chars, length);
     heapChars[length] = '\0';
-    return allocateString(heapChars, length, hash);
+    return rememberTinyString(internString(heapChars, length, hash));
+}
+
+// Creates the 256 single-byte strings up front. They are GC roots, so indexing
+// a string never allocates.
+void initCharStrings()
+{
+    for (int i = 0; i < UINT8_COUNT; i++)
+    {
+        vm.charStrings[i] = NULL;
+    }
+
+    for (int i = 0; i < UINT8_COUNT; i++)
+    {
+        char ch = (char)i;
+        vm.charStrings[i] = copyString(&ch, 1);
+    }
 }
 
 static void printFunction(ObjFunction *function)
@@ -105,14 +236,8 @@ void printObject(Value value)
         printf("<native fn>");
         break;
     case OBJ_STRING: {
-        char *converted = convert_string(AS_CSTRING(value));
-
-        if (converted != NULL)
-        {
-            printf("%s", converted);
-            free(converted);
-        }
-
+        ObjString *string = AS_STRING(value);
+        fwrite(string->chars, sizeof(char), string->length, stdout);
         break;
     }
     case OBJ_LIST: {
@@ -126,7 +251,35 @@ void printObject(Value value)
                 printf(", ");
         }
         printf("]");
+        break;
+    }
+    case OBJ_BUILDER: {
+        ObjBuilder *builder = AS_BUILDER(value);
+        if (builder->length > 0)
+            fwrite(builder->chars, sizeof(char), builder->length, stdout);
+        break;
+    }
+    case OBJ_DICT: {
+        ObjDict *dict = AS_DICT(value);
+        printf("{");
+        for (int i = 0, printed = 0; i < dict->capacity; i++)
+        {
+            DictEntry *entry = &dict->entries[i];
+            if (IS_UNDEFINED(entry->key))
+                continue;
+
+            if (printed++ > 0)
+                printf(", ");
+            printValue(entry->key);
+            printf(": ");
+            printValue(entry->value);
+        }
+        printf("}");
+        break;
     }
+    case OBJ_BITSET:
+        printf("<bitset %d>", AS_BITSET(value)->length);
+        break;
     }
 }
 
@@ -146,16 +299,20 @@ void appendToList(ObjList *list, Value value)
     {
         int oldCapacity = list->capacity;
         list->capacity = GROW_CAPACITY(oldCapacity);
+        if (heapProfiling)
+            profileObject(OBJ_LIST);
         list->items = GROW_ARRAY(Value, list->items, oldCapacity, list->capacity);
     }
     list->items[list->count] = value;
     list->count++;
+    writeBarrier((Obj *)list, value);
     return;
 }
 
 void storeToList(ObjList *list, int index, Value value)
 {
     list->items[index] = value;
+    writeBarrier((Obj *)list, value);
 }
 
 Value indexFromList(ObjList *list, int index)
@@ -173,7 +330,33 @@ void deleteFromList(ObjList *list, int index)
     list->count--;
 }
 
-bool isValidListIndex(ObjList *list, int index)
+// Copies the items in [start, end) into a new list.
+ObjList *sliceList(ObjList *list, int start, int end)
+{
+    int count = end > start ? end - start : 0;
+    ObjList *slice = newList();
+    if (count == 0)
+        return slice;
+
+    push(OBJ_VAL(slice));
+    if (heapProfiling)
+        profileObject(OBJ_LIST);
+    slice->items = ALLOCATE(Value, count);
+    slice->capacity = count;
+    pop();
+
+    // The allocation may have promoted the slice, and marked it too, so each
+    // item goes through the write barrier.
+    for (int i = 0; i < count; i++)
+    {
+        slice->items[i] = list->items[start + i];
+        writeBarrier((Obj *)slice, slice->items[i]);
+    }
+    slice->count = count;
+    return slice;
+}
+
+bool isValidListIndex(ObjList *list, int64_t index)
 {
     if (index < -list->count || index > list->count - 1)
     {
@@ -184,12 +367,11 @@ bool isValidListIndex(ObjList *list, int index)
 
 Value indexFromString(ObjString *str, int index)
 {
-    char ch[2] = "\0";
-    ch[0] = str->chars[(index < 0) * str->length + index];
-    return OBJ_VAL(copyString(ch, 1));
+    uint8_t ch = (uint8_t)str->chars[(index < 0) * str->length + index];
+    return OBJ_VAL(vm.charStrings[ch]);
 }
 
-bool isValidStringIndex(ObjString *str, int index)
+bool isValidStringIndex(ObjString *str, int64_t index)
 {
     if (index < -str->length || index > str->length - 1)
     {
@@ -198,6 +380,73 @@ bool isValidStringIndex(ObjString *str, int index)
     return true;
 }
 
+ObjBuilder *newBuilder()
+{
+    ObjBuilder *builder = ALLOCATE_OBJ(ObjBuilder, OBJ_BUILDER);
+    builder->length = 0;
+    builder->capacity = 0;
+    builder->chars = NULL;
+    return builder;
+}
+
+// Appends a string or the contents of a builder, which may be this one.
+void appendToBuilder(ObjBuilder *builder, Value value)
+{
+    int length = IS_STRING(value) ? AS_STRING(value)->length : AS_BUILDER(value)->length;
+
+    // Doubling keeps a run of appends linear overall.
+    if (builder->capacity < builder->length + length + 1)
+    {
+        int oldCapacity = builder->capacity;
+        while (builder->capacity < builder->length + length + 1)
+            builder->capacity = GROW_CAPACITY(builder->capacity);
+        if (heapProfiling)
+            profileObject(OBJ_BUILDER);
+        builder->chars = GROW_ARRAY(char, builder->chars, oldCapacity, builder->capacity);
+    }
+
+    // Read the source only now, in case it is this builder and just moved.
+    const char *chars = IS_STRING(value) ? AS_STRING(value)->chars : AS_BUILDER(value)->chars;
+    memcpy(builder->chars + builder->length, chars, length);
+    builder->length += length;
+    builder->chars[builder->length] = '\0';
+}
+
+ObjString *buildString(ObjBuilder *builder)
+{
+    return newString(builder->chars == NULL ? "" : builder->chars, builder->length);
+}
+
+ObjDict *newDict()
+{
+    ObjDict *dict = ALLOCATE_OBJ(ObjDict, OBJ_DICT);
+    dict->count = 0;
+    dict->tombstones = 0;
+    dict->capacity = 0;
+    dict->control = NULL;
+    dict->entries = NULL;
+    return dict;
+}
+
+// Starts with every bit clear.
+ObjBitset *newBitset(int length)
+{
+    ObjBitset *bitset = ALLOCATE_OBJ(ObjBitset, OBJ_BITSET);
+    bitset->length = 0;
+    bitset->words = NULL;
+    if (length == 0)
+        return bitset;
+
+    push(OBJ_VAL(bitset));
+    if (heapProfiling)
+        profileObject(OBJ_BITSET);
+    bitset->words = ALLOCATE(uint64_t, BITSET_WORDS(length));
+    memset(bitset->words, 0, sizeof(uint64_t) * BITSET_WORDS(length));
+    bitset->length = length;
+    pop();
+    return bitset;
+}
+
 bool isInt(double num)
 {
     double fraction = num - ((long)num);
@@ -1,8 +1,11 @@
 #ifndef purr_object_h
 #define purr_object_h
 
+#include <string.h>
+
 #include "chunk.h"
 #include "common.h"
+#include "hash.h"
 #include "value.h"
 
 #define OBJ_TYPE(value) (AS_OBJ(value)->type)
@@ -11,12 +14,24 @@
 #define IS_NATIVE(value) isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
 #define IS_LIST(value) isObjType(value, OBJ_LIST)
+#define IS_BUILDER(value) isObjType(value, OBJ_BUILDER)
+#define IS_DICT(value) isObjType(value, OBJ_DICT)
+#define IS_BITSET(value) isObjType(value, OBJ_BITSET)
 
 #define AS_FUNCTION(value) ((ObjFunction *)AS_OBJ(value))
 #define AS_NATIVE(value) (((ObjNative *)AS_OBJ(value))->function)
 #define AS_STRING(value) ((ObjString *)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString *)AS_OBJ(value))->chars)
 #define AS_LIST(value) ((ObjList *)AS_OBJ(value))
+#define AS_BUILDER(value) ((ObjBuilder *)AS_OBJ(value))
+#define AS_DICT(value) ((ObjDict *)AS_OBJ(value))
+#define AS_BITSET(value) ((ObjBitset *)AS_OBJ(value))
+
+// Strings of up to TINY_STRING_MAX bytes are found by their contents in a
+// small direct-mapped cache before they are hashed and interned.
+#define TINY_STRING_MAX 8
+#define TINY_CACHE_BITS 10
+#define TINY_CACHE_SIZE (1 << TINY_CACHE_BITS)
 
 typedef enum
 {
@@ -24,11 +39,17 @@ typedef enum
     OBJ_NATIVE,
     OBJ_STRING,
     OBJ_LIST,
+    OBJ_BUILDER,
+    OBJ_DICT,
+    OBJ_BITSET,
 } ObjType;
 
 struct Obj
 {
     ObjType type;
+    bool isMarked;
+    bool isOld;
+    bool isRemembered;
     struct Obj *next;
 };
 
@@ -36,6 +57,7 @@ typedef struct
 {
     Obj obj;
     int arity;
+    int stackSize; // Peak stack slots a call needs, including the callee and arguments.
     Chunk chunk;
     ObjString *name;
 } ObjFunction;
@@ -48,12 +70,22 @@ typedef struct
     NativeFn function;
 } ObjNative;
 
+// Only strings from the compiler and the VM itself are interned. Strings built
+// while the program runs are not, and hash themselves on first demand.
+//
+// A view is a slice whose characters still live in `parent`. The parent is not
+// kept alive by its views; when it dies, the collector gives each surviving view
+// its own copy. So a view's `chars` may move at any allocation, and are not
+// NUL-terminated.
 struct ObjString
 {
     Obj obj;
     int length;
     char *chars;
+    struct ObjString *parent;
     uint32_t hash;
+    bool hasHash;
+    bool isInterned;
 };
 
 typedef struct
@@ -64,20 +96,71 @@ typedef struct
     Value *items;
 } ObjList;
 
+// A mutable string that grows in place, so text built up piece by piece is
+// copied and interned once, by build(), instead of on every concatenation.
+typedef struct
+{
+    Obj obj;
+    int length;
+    int capacity;
+    char *chars;
+} ObjBuilder;
+
+// Unused slots have an undefined key.
+typedef struct
+{
+    Value key;
+    Value value;
+} DictEntry;
+
+// A hash map keyed by any hashable value, laid out like Table; see dict.c.
+typedef struct
+{
+    Obj obj;
+    int count;
+    int tombstones;
+    int capacity;
+    uint8_t *control;
+    DictEntry *entries;
+} ObjDict;
+
+#define BITSET_WORDS(length) (((length) + 63) / 64)
+
+// A fixed number of bits packed into words. Bits past the length are zero.
+typedef struct
+{
+    Obj obj;
+    int length;
+    uint64_t *words;
+} ObjBitset;
+
 ObjFunction *newFunction();
 ObjNative *newNative(NativeFn function);
 
 ObjString *takeString(char *chars, int length);
 ObjString *copyString(const char *chars, int length);
+ObjString *newString(const char *chars, int length);
+ObjString *sliceString(ObjString *string, int start, int end);
+void initCharStrings();
+void forgetTinyString(ObjString *string);
 Value indexFromString(ObjString *str, int index);
-bool isValidStringIndex(ObjString *str, int index);
+bool isValidStringIndex(ObjString *str, int64_t index);
 
 ObjList *newList();
 void appendToList(ObjList *list, Value value);
 void storeToList(ObjList *list, int index, Value value);
 Value indexFromList(ObjList *list, int index);
 void deleteFromList(ObjList *list, int index);
-bool isValidListIndex(ObjList *list, int index);
+ObjList *sliceList(ObjList *list, int start, int end);
+bool isValidListIndex(ObjList *list, int64_t index);
+
+ObjBuilder *newBuilder();
+void appendToBuilder(ObjBuilder *builder, Value value);
+ObjString *buildString(ObjBuilder *builder);
+
+ObjDict *newDict();
+
+ObjBitset *newBitset(int length);
 
 bool isInt(double num);
 
@@ -88,4 +171,26 @@ static inline bool isObjType(Value value, ObjType type)
     return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
-#endif
\ No newline at end of file
+static inline uint32_t stringHash(ObjString *string)
+{
+    if (!string->hasHash)
+    {
+        string->hash = hashString(string->chars, string->length);
+        string->hasHash = true;
+    }
+    return string->hash;
+}
+
+static inline bool stringsEqual(ObjString *a, ObjString *b)
+{
+    if (a == b)
+        return true;
+    // Two distinct interned strings always differ.
+    if (a->length != b->length || (a->isInterned && b->isInterned))
+        return false;
+    if (a->hasHash && b->hasHash && a->hash != b->hash)
+        return false;
+    return memcmp(a->chars, b->chars, a->length) == 0;
+}
+
+#endif
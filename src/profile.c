@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "profile.h"
+#include "vm.h"
+
+#define SITE_MAX_LOAD 0.75
+
+// Kinds are ObjType values, or KIND_DATA for memory that belongs to no object
+// the script sees: bytecode, constants, tables and the stack.
+#define KIND_DATA -1
+#define KIND_COUNT (OBJ_BITSET + 2)
+
+typedef struct
+{
+    // Copied rather than borrowed, since the function may be collected before
+    // the report is written. NULL marks an empty slot.
+    char *function;
+    int line;
+    int kind;
+    uint32_t hash;
+    size_t bytes;
+    size_t count;
+} Site;
+
+bool heapProfiling = false;
+
+static Site *sites = NULL;
+static int siteCount = 0;
+static int siteCapacity = 0;
+
+static int pendingKind = KIND_DATA;
+static size_t peakBytes = 0;
+
+static uint32_t hashSite(const char *function, int line, int kind)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = function; *c != '\0'; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619;
+    }
+    hash ^= (uint32_t)line * 31 + (uint32_t)(kind + 1);
+    hash *= 16777619;
+    return hash;
+}
+
+static Site *findSlot(Site *table, int capacity, const char *function, int line, int kind, uint32_t hash)
+{
+    uint32_t index = hash & (capacity - 1);
+    for (;;)
+    {
+        Site *site = &table[index];
+        if (site->function == NULL ||
+            (site->hash == hash && site->line == line && site->kind == kind && strcmp(site->function, function) == 0))
+            return site;
+
+        index = (index + 1) & (capacity - 1);
+    }
+}
+
+// The profiler keeps its table off the collected heap, so recording an
+// allocation can never cause another one.
+static void growSites()
+{
+    int capacity = siteCapacity < 64 ? 64 : siteCapacity * 2;
+    Site *table = (Site *)calloc(capacity, sizeof(Site));
+    if (table == NULL)
+        exit(1);
+
+    for (int i = 0; i < siteCapacity; i++)
+    {
+        Site *site = &sites[i];
+        if (site->function != NULL)
+            *findSlot(table, capacity, site->function, site->line, site->kind, site->hash) = *site;
+    }
+
+    free(sites);
+    sites = table;
+    siteCapacity = capacity;
+}
+
+// Charges the next allocation to the given object type, whether it is the
+// object itself or its characters or items.
+void profileObject(ObjType type)
+{
+    pendingKind = type;
+}
+
+void profileAllocation(size_t bytes)
+{
+    int kind = pendingKind;
+    pendingKind = KIND_DATA;
+
+    if (vm.bytesAllocated > peakBytes)
+        peakBytes = vm.bytesAllocated;
+
+    // Allocations made while no frame is running come from initVM() and the
+    // compiler.
+    char function[256] = "(no frame)";
+    int line = 0;
+    if (vm.frameCount > 0)
+    {
+        CallFrame *frame = &vm.frames[vm.frameCount - 1];
+        ObjFunction *running = frame->function;
+        if (running->name == NULL)
+            strcpy(function, "script");
+        else
+            snprintf(function, sizeof(function), "%s()", running->name->chars);
+        line = getLine(&running->chunk, (int)(frame->ip - running->chunk.code - 1));
+    }
+
+    if (siteCount + 1 > siteCapacity * SITE_MAX_LOAD)
+        growSites();
+
+    uint32_t hash = hashSite(function, line, kind);
+    Site *site = findSlot(sites, siteCapacity, function, line, kind, hash);
+    if (site->function == NULL)
+    {
+        site->function = strdup(function);
+        site->line = line;
+        site->kind = kind;
+        site->hash = hash;
+        siteCount++;
+    }
+
+    site->bytes += bytes;
+    site->count++;
+}
+
+static const char *kindName(int kind)
+{
+    switch (kind)
+    {
+    case OBJ_FUNCTION:
+        return "function";
+    case OBJ_NATIVE:
+        return "native";
+    case OBJ_STRING:
+        return "string";
+    case OBJ_LIST:
+        return "list";
+    case OBJ_BUILDER:
+        return "builder";
+    case OBJ_DICT:
+        return "dict";
+    case OBJ_BITSET:
+        return "bitset";
+    default:
+        return "data";
+    }
+}
+
+static int compareSites(const void *a, const void *b)
+{
+    const Site *left = *(const Site **)a;
+    const Site *right = *(const Site **)b;
+    if (left->bytes != right->bytes)
+        return left->bytes < right->bytes ? 1 : -1;
+    if (left->count != right->count)
+        return left->count < right->count ? 1 : -1;
+    return left->line - right->line;
+}
+
+void printHeapProfile(FILE *file)
+{
+    Site **sorted = (Site **)malloc(sizeof(Site *) * (siteCount + 1));
+    if (sorted == NULL)
+        return;
+
+    size_t kindBytes[KIND_COUNT] = {0};
+    size_t kindCount[KIND_COUNT] = {0};
+    size_t totalBytes = 0;
+    size_t totalCount = 0;
+
+    int count = 0;
+    for (int i = 0; i < siteCapacity; i++)
+    {
+        Site *site = &sites[i];
+        if (site->function == NULL)
+            continue;
+
+        sorted[count++] = site;
+        kindBytes[site->kind + 1] += site->bytes;
+        kindCount[site->kind + 1] += site->count;
+        totalBytes += site->bytes;
+        totalCount += site->count;
+    }
+    qsort(sorted, count, sizeof(Site *), compareSites);
+
+    fprintf(file, "== heap profile ==\n");
+    fprintf(file, "peak heap %zu bytes, current %zu bytes\n", peakBytes, vm.bytesAllocated);
+    fprintf(file, "allocated %zu bytes in %zu allocations\n\n", totalBytes, totalCount);
+
+    fprintf(file, "%12s %10s  %s\n", "bytes", "count", "type");
+    for (int kind = KIND_DATA; kind < KIND_COUNT - 1; kind++)
+    {
+        if (kindCount[kind + 1] > 0)
+            fprintf(file, "%12zu %10zu  %s\n", kindBytes[kind + 1], kindCount[kind + 1], kindName(kind));
+    }
+
+    fprintf(file, "\n%12s %10s  %-8s  %s\n", "bytes", "count", "type", "site");
+    for (int i = 0; i < count; i++)
+    {
+        Site *site = sorted[i];
+        if (site->line == 0)
+            fprintf(file, "%12zu %10zu  %-8s  %s\n", site->bytes, site->count, kindName(site->kind), site->function);
+        else
+            fprintf(file, "%12zu %10zu  %-8s  [line %d] in %s\n", site->bytes, site->count, kindName(site->kind),
+                    site->line, site->function);
+    }
+
+    free(sorted);
+}
+
+void freeHeapProfile()
+{
+    for (int i = 0; i < siteCapacity; i++)
+    {
+        free(sites[i].function);
+    }
+
+    free(sites);
+    sites = NULL;
+    siteCount = 0;
+    siteCapacity = 0;
+}
@@ -0,0 +1,19 @@
+#ifndef purr_profile_h
+#define purr_profile_h
+
+#include <stdio.h>
+
+#include "common.h"
+#include "object.h"
+
+// Set by --heap-profile. Every allocation that grows the heap is then charged
+// to the function and line running at the time, and to the kind of object it
+// was for. When the flag is clear the allocator only pays for testing it.
+extern bool heapProfiling;
+
+void profileObject(ObjType type);
+void profileAllocation(size_t bytes);
+void printHeapProfile(FILE *file);
+void freeHeapProfile();
+
+#endif
@@ -173,7 +173,17 @@ static TokenType identifierType()
         }
         break;
     case 'i':
-        return checkKeyword(1, 1, "f", TOKEN_IF);
+        if (scanner.current - scanner.start > 1)
+        {
+            switch (scanner.start[1])
+            {
+            case 'f':
+                return checkKeyword(2, 0, "", TOKEN_IF);
+            case 'n':
+                return checkKeyword(2, 0, "", TOKEN_IN);
+            }
+        }
+        break;
     case 'n':
         if (scanner.current - scanner.start > 1)
         {
@@ -281,6 +291,10 @@ Token scanToken()
         return makeToken(TOKEN_LEFT_BRACKET);
     case ']':
         return makeToken(TOKEN_RIGHT_BRACKET);
+    case '{':
+        return makeToken(TOKEN_LEFT_BRACE);
+    case '}':
+        return makeToken(TOKEN_RIGHT_BRACE);
     case ':':
         return makeToken(TOKEN_COLON);
     case ';':
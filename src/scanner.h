@@ -8,6 +8,8 @@ typedef enum
     TOKEN_RIGHT_PAREN,
     TOKEN_LEFT_BRACKET,
     TOKEN_RIGHT_BRACKET,
+    TOKEN_LEFT_BRACE,
+    TOKEN_RIGHT_BRACE,
     TOKEN_COMMA,
     TOKEN_DOT,
     TOKEN_MINUS,
@@ -49,6 +51,7 @@ typedef enum
     TOKEN_FALSE,
     TOKEN_FOR,
     TOKEN_IF,
+    TOKEN_IN,
     TOKEN_NONE,
     TOKEN_NOT,
     TOKEN_OR,
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "search.h"
+
+// Substring search for the string natives. A one-byte needle is left to
+// memchr(), which libc already vectorizes. Longer needles are matched a block
+// of candidate positions at a time: the needle's first and last bytes are
+// compared against the haystack in vector registers, and only positions where
+// both match are checked in full. Build with -DNO_SIMD for the scalar loop.
+
+#if !defined(NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define VECTOR __m256i
+#define SPLAT(byte) _mm256_set1_epi8(byte)
+#define LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define MATCHES(first, last, a, b)                                                                                     \
+    (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, a), _mm256_cmpeq_epi8(last, b)))
+#elif !defined(NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define VECTOR __m128i
+#define SPLAT(byte) _mm_set1_epi8(byte)
+#define LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define MATCHES(first, last, a, b)                                                                                     \
+    (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, a), _mm_cmpeq_epi8(last, b)))
+#endif
+
+// Finds the needle, which is at least two bytes long. With `count` NULL it
+// returns the first offset or -1; otherwise it counts the non-overlapping
+// occurrences into *count.
+static int scan(const char *haystack, int length, const char *needle, int needleLength, int *count)
+{
+    // Candidate starts run from 0 to `last`; a match may not start before `next`.
+    int last = length - needleLength;
+    int next = 0;
+    int found = 0;
+    int i = 0;
+
+#ifdef SIMD_WIDTH
+    VECTOR firstByte = SPLAT(needle[0]);
+    VECTOR lastByte = SPLAT(needle[needleLength - 1]);
+    for (; i + 2 * SIMD_WIDTH - 1 <= last; i += 2 * SIMD_WIDTH)
+    {
+        // Two blocks per round keep up with libc's memchr() when matches of
+        // the first byte are rare.
+        const char *block = haystack + i;
+        uint64_t mask = MATCHES(firstByte, lastByte, LOAD(block), LOAD(block + needleLength - 1));
+        mask |= (uint64_t)MATCHES(firstByte, lastByte, LOAD(block + SIMD_WIDTH),
+                                  LOAD(block + SIMD_WIDTH + needleLength - 1))
+                << SIMD_WIDTH;
+
+        for (; mask != 0; mask &= mask - 1)
+        {
+            int offset = i + __builtin_ctzll(mask);
+            if (offset < next || memcmp(haystack + offset + 1, needle + 1, needleLength - 2) != 0)
+                continue;
+            if (count == NULL)
+                return offset;
+
+            found++;
+            next = offset + needleLength;
+        }
+    }
+#endif
+
+    if (i < next)
+        i = next;
+    while (i <= last)
+    {
+        const char *candidate = memchr(haystack + i, needle[0], last - i + 1);
+        if (candidate == NULL)
+            break;
+
+        i = (int)(candidate - haystack);
+        if (memcmp(haystack + i + 1, needle + 1, needleLength - 1) != 0)
+        {
+            i++;
+            continue;
+        }
+        if (count == NULL)
+            return i;
+
+        found++;
+        i += needleLength;
+    }
+
+    if (count != NULL)
+        *count = found;
+    return -1;
+}
+
+// Returns the offset of the first occurrence of the needle, or -1.
+int findChars(const char *haystack, int length, const char *needle, int needleLength)
+{
+    if (needleLength == 0)
+        return 0;
+    if (needleLength > length)
+        return -1;
+    if (needleLength == 1)
+    {
+        const char *found = memchr(haystack, needle[0], length);
+        return found == NULL ? -1 : (int)(found - haystack);
+    }
+
+    return scan(haystack, length, needle, needleLength, NULL);
+}
+
+// Counts non-overlapping occurrences. An empty needle matches between every
+// pair of bytes and at both ends.
+int countChars(const char *haystack, int length, const char *needle, int needleLength)
+{
+    if (needleLength == 0)
+        return length + 1;
+    if (needleLength > length)
+        return 0;
+
+    int count = 0;
+    if (needleLength == 1)
+    {
+        const char *end = haystack + length;
+        for (const char *p = haystack; (p = memchr(p, needle[0], end - p)) != NULL; p++)
+            count++;
+        return count;
+    }
+
+    scan(haystack, length, needle, needleLength, &count);
+    return count;
+}
@@ -0,0 +1,9 @@
+#ifndef purr_search_h
+#define purr_search_h
+
+#include "common.h"
+
+int findChars(const char *haystack, int length, const char *needle, int needleLength);
+int countChars(const char *haystack, int length, const char *needle, int needleLength);
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+
+#ifndef NO_SLAB_ALLOC
+
+#define CLASS_OF(size) (((size)-1) / SLAB_GRANULE)
+
+typedef struct FreeBlock
+{
+    struct FreeBlock *next;
+} FreeBlock;
+
+// Every slab starts with a link to the previous one so they can all be
+// released at exit. The header takes a whole granule to keep blocks aligned.
+typedef struct Slab
+{
+    struct Slab *next;
+} Slab;
+
+typedef struct
+{
+    FreeBlock *free;
+    char *next;
+    char *end;
+#ifdef DEBUG_SLAB_STATS
+    size_t allocations;
+    size_t live;
+    size_t peak;
+    int slabCount;
+#endif
+} SizeClass;
+
+static SizeClass classes[SLAB_CLASSES];
+static Slab *slabs = NULL;
+
+static bool newSlab(SizeClass *sizeClass)
+{
+    Slab *slab = (Slab *)malloc(SLAB_SIZE);
+    if (slab == NULL)
+        return false;
+
+    slab->next = slabs;
+    slabs = slab;
+
+    sizeClass->next = (char *)slab + SLAB_GRANULE;
+    sizeClass->end = (char *)slab + SLAB_SIZE;
+#ifdef DEBUG_SLAB_STATS
+    sizeClass->slabCount++;
+#endif
+    return true;
+}
+
+static void *allocateBlock(size_t size)
+{
+    SizeClass *sizeClass = &classes[CLASS_OF(size)];
+    void *block;
+
+    if (sizeClass->free != NULL)
+    {
+        block = sizeClass->free;
+        sizeClass->free = sizeClass->free->next;
+    }
+    else
+    {
+        size_t blockSize = (CLASS_OF(size) + 1) * SLAB_GRANULE;
+        if ((size_t)(sizeClass->end - sizeClass->next) < blockSize && !newSlab(sizeClass))
+            return NULL;
+
+        block = sizeClass->next;
+        sizeClass->next += blockSize;
+    }
+
+#ifdef DEBUG_SLAB_STATS
+    sizeClass->allocations++;
+    if (++sizeClass->live > sizeClass->peak)
+        sizeClass->peak = sizeClass->live;
+#endif
+    return block;
+}
+
+void slabFree(void *pointer, size_t size)
+{
+    if (pointer == NULL)
+        return;
+
+    if (size > SLAB_MAX_SIZE)
+    {
+        free(pointer);
+        return;
+    }
+
+    SizeClass *sizeClass = &classes[CLASS_OF(size)];
+    FreeBlock *block = (FreeBlock *)pointer;
+    block->next = sizeClass->free;
+    sizeClass->free = block;
+#ifdef DEBUG_SLAB_STATS
+    sizeClass->live--;
+#endif
+}
+
+void *slabRealloc(void *pointer, size_t oldSize, size_t newSize)
+{
+    if (oldSize > SLAB_MAX_SIZE && newSize > SLAB_MAX_SIZE)
+        return realloc(pointer, newSize);
+
+    // The block already has room for anything in its size class.
+    if (pointer != NULL && oldSize <= SLAB_MAX_SIZE && newSize <= SLAB_MAX_SIZE &&
+        CLASS_OF(oldSize) == CLASS_OF(newSize))
+        return pointer;
+
+    void *result = newSize <= SLAB_MAX_SIZE ? allocateBlock(newSize) : malloc(newSize);
+    if (result == NULL)
+        return NULL;
+
+    if (pointer != NULL)
+    {
+        memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+        slabFree(pointer, oldSize);
+    }
+    return result;
+}
+
+void freeSlabs()
+{
+#ifdef DEBUG_SLAB_STATS
+    printSlabStats();
+#endif
+
+    while (slabs != NULL)
+    {
+        Slab *next = slabs->next;
+        free(slabs);
+        slabs = next;
+    }
+
+    memset(classes, 0, sizeof(classes));
+}
+
+#ifdef DEBUG_SLAB_STATS
+void printSlabStats()
+{
+    fprintf(stderr, "%6s %12s %10s %10s %6s\n", "size", "allocations", "live", "peak", "slabs");
+    for (int i = 0; i < SLAB_CLASSES; i++)
+    {
+        SizeClass *sizeClass = &classes[i];
+        if (sizeClass->allocations == 0)
+            continue;
+
+        fprintf(stderr, "%6d %12zu %10zu %10zu %6d\n", (i + 1) * SLAB_GRANULE, sizeClass->allocations,
+                sizeClass->live, sizeClass->peak, sizeClass->slabCount);
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef purr_slab_h
+#define purr_slab_h
+
+#include <stdlib.h>
+
+#include "common.h"
+
+// Blocks up to SLAB_MAX_SIZE bytes come from per-size-class pools, rounded up
+// to a multiple of SLAB_GRANULE. Each pool carves SLAB_SIZE-byte slabs from
+// malloc and reuses freed blocks through a free list. Build with -DNO_SLAB_ALLOC
+// to hand every allocation straight to malloc.
+#define SLAB_GRANULE 16
+#define SLAB_MAX_SIZE 256
+#define SLAB_CLASSES (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_SIZE (64 * 1024)
+
+#ifdef NO_SLAB_ALLOC
+
+#define slabRealloc(pointer, oldSize, newSize) realloc(pointer, newSize)
+#define slabFree(pointer, size) free(pointer)
+#define freeSlabs()
+
+#else
+
+// Resizes a block the way realloc does, but the caller supplies the old size,
+// which is how a block finds its way back to its pool.
+void *slabRealloc(void *pointer, size_t oldSize, size_t newSize);
+void slabFree(void *pointer, size_t size);
+void freeSlabs();
+
+#endif
+
+// Build with -DDEBUG_SLAB_STATS to count blocks per size class and print the
+// totals when the VM shuts down.
+#if defined(DEBUG_SLAB_STATS) && !defined(NO_SLAB_ALLOC)
+void printSlabStats();
+#endif
+
+#endif
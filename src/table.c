@@ -6,50 +6,60 @@
 #include "table.h"
 #include "value.h"
 
-#define TABLE_MAX_LOAD 0.75
+// A SwissTable-style hash table. The capacity is a power of two, split into
+// groups of TABLE_GROUP_SIZE slots. Each slot has a control byte: the low seven
+// bits of its key's hash when full, or CONTROL_EMPTY or CONTROL_DELETED, both
+// of which have the top bit set. A lookup starts at the group picked by the
+// rest of the hash, compares the fragment against a whole group of control
+// bytes at once, and only looks at the keys of the slots that match. It stops
+// at the first group that has an empty slot.
 
 void initTable(Table *table)
 {
     table->count = 0;
+    table->tombstones = 0;
     table->capacity = 0;
+    table->control = NULL;
     table->entries = NULL;
 }
 
 void freeTable(Table *table)
 {
+    FREE_ARRAY(uint8_t, table->control, table->capacity);
     FREE_ARRAY(Entry, table->entries, table->capacity);
     initTable(table);
 }
 
-static Entry *findEntry(Entry *entries, int capacity, ObjString *key)
+// Returns the slot holding the key, or -1. The table must not be empty.
+static int findSlot(Table *table, ObjString *key, uint32_t hash)
 {
-    uint32_t index = key->hash % capacity;
-    Entry *tombstone = NULL;
-
-    for (;;)
+    int group = FIRST_GROUP(table->capacity, hash);
+    for (int step = 1;; step++)
     {
-        Entry *entry = &entries[index];
-        if (entry->key == NULL)
-        {
-            if (IS_NONE(entry->value))
-            {
-                // Empty entry.
-                return tombstone != NULL ? tombstone : entry;
-            }
-            else
-            {
-                // We found a tombstone.
-                if (tombstone == NULL)
-                    tombstone = entry;
-            }
-        }
-        else if (entry->key == key)
+        const uint8_t *control = table->control + group * TABLE_GROUP_SIZE;
+        for (uint32_t mask = matchByte(control, FRAGMENT(hash)); mask != 0; mask &= mask - 1)
         {
-            // We found the key.
-            return entry;
+            int slot = group * TABLE_GROUP_SIZE + __builtin_ctz(mask);
+            if (table->entries[slot].key == key)
+                return slot;
         }
 
-        index = (index + 1) % capacity;
+        if (matchByte(control, CONTROL_EMPTY) != 0)
+            return -1;
+        group = NEXT_GROUP(table->capacity, group, step);
+    }
+}
+
+// Returns the first empty or deleted slot on the key's probe sequence.
+static int findFreeSlot(Table *table, uint32_t hash)
+{
+    int group = FIRST_GROUP(table->capacity, hash);
+    for (int step = 1;; step++)
+    {
+        uint32_t mask = matchFree(table->control + group * TABLE_GROUP_SIZE);
+        if (mask != 0)
+            return group * TABLE_GROUP_SIZE + __builtin_ctz(mask);
+        group = NEXT_GROUP(table->capacity, group, step);
     }
 }
 
@@ -58,57 +68,69 @@ bool tableGet(Table *table, ObjString *key, Value *value)
     if (table->count == 0)
         return false;
 
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL)
+    int slot = findSlot(table, key, stringHash(key));
+    if (slot < 0)
         return false;
 
-    *value = entry->value;
+    *value = table->entries[slot].value;
     return true;
 }
 
+static void insertEntry(Table *table, ObjString *key, Value value, uint32_t hash)
+{
+    int slot = findFreeSlot(table, hash);
+    if (table->control[slot] == CONTROL_DELETED)
+        table->tombstones--;
+
+    table->control[slot] = FRAGMENT(hash);
+    table->entries[slot].key = key;
+    table->entries[slot].value = value;
+    table->count++;
+}
+
 static void adjustCapacity(Table *table, int capacity)
 {
+    // Both allocations can collect, and a collection may delete from the old
+    // table, so it is only read once they are done.
+    uint8_t *control = ALLOCATE(uint8_t, capacity);
     Entry *entries = ALLOCATE(Entry, capacity);
-    for (int i = 0; i < capacity; i++)
-    {
-        entries[i].key = NULL;
-        entries[i].value = NONE_VAL;
-    }
+    memset(control, CONTROL_EMPTY, capacity);
 
-    table->count = 0;
+    Table resized = {0, 0, capacity, control, entries};
     for (int i = 0; i < table->capacity; i++)
     {
-        Entry *entry = &table->entries[i];
-        if (entry->key == NULL)
+        if (table->control[i] & 0x80)
             continue;
 
-        Entry *dest = findEntry(entries, capacity, entry->key);
-        dest->key = entry->key;
-        dest->value = entry->value;
-        table->count++;
+        Entry *entry = &table->entries[i];
+        insertEntry(&resized, entry->key, entry->value, stringHash(entry->key));
     }
 
-    FREE_ARRAY(Entry, table->entries, table->capacity);
-    table->entries = entries;
-    table->capacity = capacity;
+    freeTable(table);
+    *table = resized;
 }
 
 bool tableSet(Table *table, ObjString *key, Value value)
 {
-    if (table->count + 1 > table->capacity * TABLE_MAX_LOAD)
+    uint32_t hash = stringHash(key);
+    int slot = table->count > 0 ? findSlot(table, key, hash) : -1;
+    if (slot >= 0)
     {
-        int capacity = GROW_CAPACITY(table->capacity);
-        adjustCapacity(table, capacity);
+        table->entries[slot].value = value;
+        return false;
     }
 
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    bool isNewKey = entry->key == NULL;
-    if (isNewKey && IS_NONE(entry->value))
-        table->count++;
+    if (table->count + table->tombstones + 1 > TABLE_MAX_LOAD(table->capacity))
+    {
+        // A table that is mostly tombstones is rebuilt at the same size.
+        int capacity = table->capacity;
+        if (table->count + 1 > TABLE_MAX_LOAD(capacity) / 2)
+            capacity = capacity < TABLE_GROUP_SIZE ? TABLE_GROUP_SIZE : capacity * 2;
+        adjustCapacity(table, capacity);
+    }
 
-    entry->key = key;
-    entry->value = value;
-    return isNewKey;
+    insertEntry(table, key, value, hash);
+    return true;
 }
 
 bool tableDelete(Table *table, ObjString *key)
@@ -116,14 +138,26 @@ bool tableDelete(Table *table, ObjString *key)
     if (table->count == 0)
         return false;
 
-    // Find the entry.
-    Entry *entry = findEntry(table->entries, table->capacity, key);
-    if (entry->key == NULL)
+    int slot = findSlot(table, key, stringHash(key));
+    if (slot < 0)
         return false;
 
-    // Place a tombstone in the entry.
-    entry->key = NULL;
-    entry->value = BOOL_VAL(true);
+    // Lookups stop at a group with an empty slot, so in such a group the slot
+    // can go back to empty. Elsewhere it has to stay a tombstone.
+    const uint8_t *group = table->control + slot / TABLE_GROUP_SIZE * TABLE_GROUP_SIZE;
+    if (matchByte(group, CONTROL_EMPTY) != 0)
+    {
+        table->control[slot] = CONTROL_EMPTY;
+    }
+    else
+    {
+        table->control[slot] = CONTROL_DELETED;
+        table->tombstones++;
+    }
+
+    table->entries[slot].key = NULL;
+    table->entries[slot].value = NONE_VAL;
+    table->count--;
     return true;
 }
 
@@ -131,11 +165,8 @@ void tableAddAll(Table *from, Table *to)
 {
     for (int i = 0; i < from->capacity; i++)
     {
-        Entry *entry = &from->entries[i];
-        if (entry->key != NULL)
-        {
-            tableSet(to, entry->key, entry->value);
-        }
+        if (!(from->control[i] & 0x80))
+            tableSet(to, from->entries[i].key, from->entries[i].value);
     }
 }
 
@@ -144,23 +175,31 @@ ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t
     if (table->count == 0)
         return NULL;
 
-    uint32_t index = hash % table->capacity;
-    for (;;)
+    int group = FIRST_GROUP(table->capacity, hash);
+    for (int step = 1;; step++)
     {
-        Entry *entry = &table->entries[index];
-        if (entry->key == NULL)
-        {
-            // Stop if we find an empty non-tombstone entry.
-            if (IS_NONE(entry->value))
-                return NULL;
-        }
-        else if (entry->key->length == length && entry->key->hash == hash &&
-                 memcmp(entry->key->chars, chars, length) == 0)
+        const uint8_t *control = table->control + group * TABLE_GROUP_SIZE;
+        for (uint32_t mask = matchByte(control, FRAGMENT(hash)); mask != 0; mask &= mask - 1)
         {
-            // We found it.
-            return entry->key;
+            ObjString *key = table->entries[group * TABLE_GROUP_SIZE + __builtin_ctz(mask)].key;
+            if (key->length == length && stringHash(key) == hash && memcmp(key->chars, chars, length) == 0)
+                return key;
         }
 
-        index = (index + 1) % table->capacity;
+        if (matchByte(control, CONTROL_EMPTY) != 0)
+            return NULL;
+        group = NEXT_GROUP(table->capacity, group, step);
+    }
+}
+
+void markTable(Table *table)
+{
+    for (int i = 0; i < table->capacity; i++)
+    {
+        if (table->control[i] & 0x80)
+            continue;
+
+        markObject((Obj *)table->entries[i].key);
+        markValue(table->entries[i].value);
     }
-}
\ No newline at end of file
+}
@@ -4,6 +4,58 @@
 #include "common.h"
 #include "value.h"
 
+#if !defined(NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Slots are probed sixteen at a time through a parallel array of control
+// bytes, one per slot; see table.c. ObjDict uses the same layout.
+#define TABLE_GROUP_SIZE 16
+
+#define CONTROL_EMPTY 0x80
+#define CONTROL_DELETED 0xfe
+
+// Full and deleted slots together may fill 7/8 of the table.
+#define TABLE_MAX_LOAD(capacity) ((capacity) / 8 * 7)
+
+#define FRAGMENT(hash) ((uint8_t)((hash)&0x7f))
+#define FIRST_GROUP(capacity, hash) ((int)((hash) >> 7) & ((capacity) / TABLE_GROUP_SIZE - 1))
+
+// Groups are visited in triangular steps, which reach every group of a
+// power-of-two table.
+#define NEXT_GROUP(capacity, group, step) (((group) + (step)) & ((capacity) / TABLE_GROUP_SIZE - 1))
+
+// Each returns a bitmask with bit i set if control byte i of the group is a
+// match, or is empty or deleted and so free to reuse.
+#if !defined(NO_SIMD) && defined(__SSE2__)
+static inline uint32_t matchByte(const uint8_t *group, uint8_t byte)
+{
+    __m128i controls = _mm_loadu_si128((const __m128i *)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8((char)byte)));
+}
+
+static inline uint32_t matchFree(const uint8_t *group)
+{
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+}
+#else
+static inline uint32_t matchByte(const uint8_t *group, uint8_t byte)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < TABLE_GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] == byte) << i;
+    return mask;
+}
+
+static inline uint32_t matchFree(const uint8_t *group)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < TABLE_GROUP_SIZE; i++)
+        mask |= (uint32_t)(group[i] >> 7) << i;
+    return mask;
+}
+#endif
+
 typedef struct
 {
     ObjString *key;
@@ -13,7 +65,9 @@ typedef struct
 typedef struct
 {
     int count;
+    int tombstones;
     int capacity;
+    uint8_t *control;
     Entry *entries;
 } Table;
 
@@ -24,5 +78,6 @@ bool tableSet(Table *table, ObjString *key, Value value);
 bool tableDelete(Table *table, ObjString *key);
 void tableAddAll(Table *from, Table *to);
 ObjString *tableFindString(Table *table, const char *chars, int length, uint32_t hash);
+void markTable(Table *table);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -33,6 +34,32 @@ void freeValueArray(ValueArray *array)
 
 void printValue(Value value)
 {
+#ifdef NAN_BOXING
+    if (IS_BOOL(value))
+    {
+        printf(AS_BOOL(value) ? "true" : "false");
+    }
+    else if (IS_NONE(value))
+    {
+        printf("none");
+    }
+    else if (IS_INT(value))
+    {
+        printf("%" PRId64, AS_INT(value));
+    }
+    else if (IS_DOUBLE(value))
+    {
+        printf("%g", AS_DOUBLE(value));
+    }
+    else if (IS_OBJ(value))
+    {
+        printObject(value);
+    }
+    else if (IS_UNDEFINED(value))
+    {
+        printf("undefined");
+    }
+#else
     switch (value.type)
     {
     case VAL_BOOL:
@@ -41,17 +68,40 @@ void printValue(Value value)
     case VAL_NONE:
         printf("none");
         break;
-    case VAL_NUMBER:
-        printf("%g", AS_NUMBER(value));
+    case VAL_DOUBLE:
+        printf("%g", AS_DOUBLE(value));
+        break;
+    case VAL_INT:
+        printf("%" PRId64, AS_INT(value));
         break;
     case VAL_OBJ:
         printObject(value);
         break;
+    case VAL_UNDEFINED:
+        printf("undefined");
+        break;
     }
+#endif
 }
 
 bool valuesEqual(Value a, Value b)
 {
+    if (IS_INT(a) && IS_INT(b))
+    {
+        return AS_INT(a) == AS_INT(b);
+    }
+    if (IS_NUMBER(a) && IS_NUMBER(b))
+    {
+        return AS_NUMBER(a) == AS_NUMBER(b);
+    }
+    if (IS_STRING(a) && IS_STRING(b))
+    {
+        return stringsEqual(AS_STRING(a), AS_STRING(b));
+    }
+
+#ifdef NAN_BOXING
+    return a == b;
+#else
     if (a.type != b.type)
         return false;
     switch (a.type)
@@ -59,12 +109,12 @@ bool valuesEqual(Value a, Value b)
     case VAL_BOOL:
         return AS_BOOL(a) == AS_BOOL(b);
     case VAL_NONE:
+    case VAL_UNDEFINED:
         return true;
-    case VAL_NUMBER:
-        return AS_NUMBER(a) == AS_NUMBER(b);
     case VAL_OBJ:
         return AS_OBJ(a) == AS_OBJ(b);
     default:
         return false; // Unreachable.
     }
+#endif
 }
\ No newline at end of file
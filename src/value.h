@@ -6,12 +6,78 @@
 typedef struct Obj Obj;
 typedef struct ObjString ObjString;
 
+#ifdef NAN_BOXING
+
+#include <string.h>
+
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NONE 1      // 001
+#define TAG_FALSE 2     // 010
+#define TAG_TRUE 3      // 011
+#define TAG_UNDEFINED 4 // 100
+
+// Integers are stored as a 48-bit two's complement payload under their own
+// quiet NaN tag, so the top 16 bits of every int Value are the same. Results
+// that do not fit are promoted to doubles.
+#define INT_TAG ((uint64_t)0x0002000000000000)
+#define INT_MASK ((uint64_t)0x0000ffffffffffff)
+#define INT_FITS(i) ((int64_t)((uint64_t)(i) << 16) >> 16 == (i))
+
+typedef uint64_t Value;
+
+#define IS_BOOL(value) (((value) | 1) == TRUE_VAL)
+#define IS_NONE(value) ((value) == NONE_VAL)
+#define IS_DOUBLE(value) (((value) & QNAN) != QNAN)
+#define IS_INT(value) (((value) >> 48) == (QNAN | INT_TAG) >> 48)
+#define IS_NUMBER(value) (IS_DOUBLE(value) || IS_INT(value))
+#define IS_OBJ(value) (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+#define BOTH_INTS(a, b) (IS_INT(a) & IS_INT(b))
+#define BOTH_DOUBLES(a, b) ((((a) & QNAN) != QNAN) & (((b) & QNAN) != QNAN))
+#define IS_UNDEFINED(value) ((value) == UNDEFINED_VAL)
+
+#define AS_BOOL(value) ((value) == TRUE_VAL)
+#define AS_DOUBLE(value) valueToNum(value)
+#define AS_INT(value) ((int64_t)((value) << 16) >> 16)
+#define AS_NUMBER(value) (IS_INT(value) ? (double)AS_INT(value) : AS_DOUBLE(value))
+#define AS_OBJ(value) ((Obj *)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+
+#define BOOL_VAL(b) ((b) ? TRUE_VAL : FALSE_VAL)
+#define FALSE_VAL ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL ((Value)(uint64_t)(QNAN | TAG_TRUE))
+#define NONE_VAL ((Value)(uint64_t)(QNAN | TAG_NONE))
+#define NUMBER_VAL(num) numToValue(num)
+#define INT_VAL(i) ((Value)(QNAN | INT_TAG | ((uint64_t)(i)&INT_MASK)))
+#define OBJ_VAL(obj) (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+
+// Marks a global slot that has been referenced but not yet defined.
+#define UNDEFINED_VAL ((Value)(uint64_t)(QNAN | TAG_UNDEFINED))
+
+static inline double valueToNum(Value value)
+{
+    double num;
+    memcpy(&num, &value, sizeof(Value));
+    return num;
+}
+
+static inline Value numToValue(double num)
+{
+    Value value;
+    memcpy(&value, &num, sizeof(double));
+    return value;
+}
+
+#else
+
 typedef enum
 {
     VAL_BOOL,
     VAL_NONE,
-    VAL_NUMBER,
-    VAL_OBJ
+    VAL_DOUBLE,
+    VAL_INT,
+    VAL_OBJ,
+    VAL_UNDEFINED
 } ValueType;
 
 typedef struct
@@ -20,24 +86,40 @@ typedef struct
     union {
         bool boolean;
         double number;
+        int64_t integer;
         Obj *obj;
     } as;
 } Value;
 
+#define INT_FITS(i) ((void)(i), true)
+
 #define IS_BOOL(value) ((value).type == VAL_BOOL)
 #define IS_NONE(value) ((value).type == VAL_NONE)
-#define IS_NUMBER(value) ((value).type == VAL_NUMBER)
+#define IS_DOUBLE(value) ((value).type == VAL_DOUBLE)
+#define IS_INT(value) ((value).type == VAL_INT)
+#define IS_NUMBER(value) (IS_DOUBLE(value) || IS_INT(value))
 #define IS_OBJ(value) ((value).type == VAL_OBJ)
+#define BOTH_INTS(a, b) (IS_INT(a) && IS_INT(b))
+#define BOTH_DOUBLES(a, b) (IS_DOUBLE(a) && IS_DOUBLE(b))
+#define IS_UNDEFINED(value) ((value).type == VAL_UNDEFINED)
 
 #define AS_OBJ(value) ((value).as.obj)
 #define AS_BOOL(value) ((value).as.boolean)
-#define AS_NUMBER(value) ((value).as.number)
+#define AS_DOUBLE(value) ((value).as.number)
+#define AS_INT(value) ((value).as.integer)
+#define AS_NUMBER(value) (IS_INT(value) ? (double)AS_INT(value) : AS_DOUBLE(value))
 
 #define BOOL_VAL(value) ((Value){VAL_BOOL, {.boolean = value}})
 #define NONE_VAL ((Value){VAL_NONE, {.number = 0}})
-#define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
+#define NUMBER_VAL(value) ((Value){VAL_DOUBLE, {.number = value}})
+#define INT_VAL(value) ((Value){VAL_INT, {.integer = value}})
 #define OBJ_VAL(object) ((Value){VAL_OBJ, {.obj = (Obj *)object}})
 
+// Marks a global slot that has been referenced but not yet defined.
+#define UNDEFINED_VAL ((Value){VAL_UNDEFINED, {.number = 0}})
+
+#endif
+
 typedef struct
 {
     int capacity;
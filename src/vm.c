@@ -1,19 +1,41 @@
+#include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "bitset.h"
 #include "cio.h"
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
+#include "dict.h"
 #include "memory.h"
 #include "object.h"
+#include "profile.h"
+#include "search.h"
+#include "slab.h"
 #include "vm.h"
 
 VM vm;
 
+static void runtimeError(const char *format, ...);
+
+// A native reports a bad call by raising the runtime error itself; callValue()
+// then sees the flag and unwinds instead of pushing the result.
+static bool nativeFailed = false;
+
+#define NATIVE_ERROR(...)                                                                                              \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        runtimeError(__VA_ARGS__);                                                                                     \
+        nativeFailed = true;                                                                                           \
+        return NONE_VAL;                                                                                               \
+    } while (false)
+
 static Value printNative(int argCount, Value *args)
 {
     for (int i = 0; i < argCount; i++)
@@ -36,8 +58,11 @@ static Value inputNative(int argCount, Value *args)
         printValue(args[0]);
     }
 
+    // The line comes from malloc(), so copy it onto the collected heap.
     string str = input(NULL);
-    return OBJ_VAL(takeString(str, strlen(str)));
+    ObjString *line = newString(str, (int)strlen(str));
+    free(str);
+    return OBJ_VAL(line);
 }
 
 static Value clockNative(int argCount, Value *args)
@@ -47,54 +72,386 @@ static Value clockNative(int argCount, Value *args)
 
 static Value lenNative(int argCount, Value *args)
 {
-    if (argCount != 1 || !IS_LIST(args[0]) || !IS_STRING(args[0]))
+    if (argCount != 1 ||
+        !(IS_LIST(args[0]) || IS_STRING(args[0]) || IS_BUILDER(args[0]) || IS_DICT(args[0]) || IS_BITSET(args[0])))
+        NATIVE_ERROR("len() takes a list, a string, a builder, a dict or a bitset.");
+
+    if (IS_LIST(args[0]))
+        return INT_VAL(AS_LIST(args[0])->count);
+    if (IS_DICT(args[0]))
+        return INT_VAL(AS_DICT(args[0])->count);
+    if (IS_BITSET(args[0]))
+        return INT_VAL(AS_BITSET(args[0])->length);
+    if (IS_BUILDER(args[0]))
+        return INT_VAL(AS_BUILDER(args[0])->length);
+    return INT_VAL(AS_STRING(args[0])->length);
+}
+
+// find(string, sub) returns where sub first occurs in string, or -1.
+static Value findNative(int argCount, Value *args)
+{
+    if (argCount != 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
+        NATIVE_ERROR("find() takes a string and a substring.");
+
+    ObjString *string = AS_STRING(args[0]);
+    ObjString *sub = AS_STRING(args[1]);
+    return INT_VAL(findChars(string->chars, string->length, sub->chars, sub->length));
+}
+
+// count(string, sub) returns how many times sub occurs without overlapping.
+// count(bitset) returns how many bits are set.
+static Value countNative(int argCount, Value *args)
+{
+    if (argCount == 1 && IS_BITSET(args[0]))
+        return INT_VAL(countBitset(AS_BITSET(args[0])));
+
+    if (argCount != 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
+        NATIVE_ERROR("count() takes a string and a substring.");
+
+    ObjString *string = AS_STRING(args[0]);
+    ObjString *sub = AS_STRING(args[1]);
+    return INT_VAL(countChars(string->chars, string->length, sub->chars, sub->length));
+}
+
+static Value startswithNative(int argCount, Value *args)
+{
+    if (argCount != 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
+        NATIVE_ERROR("startswith() takes a string and a prefix.");
+
+    ObjString *string = AS_STRING(args[0]);
+    ObjString *prefix = AS_STRING(args[1]);
+    return BOOL_VAL(prefix->length <= string->length && memcmp(string->chars, prefix->chars, prefix->length) == 0);
+}
+
+// strip(string) drops leading and trailing whitespace. The result is a slice,
+// so nothing is copied.
+static Value stripNative(int argCount, Value *args)
+{
+    if (argCount != 1 || !IS_STRING(args[0]))
+        NATIVE_ERROR("strip() takes a string.");
+
+    ObjString *string = AS_STRING(args[0]);
+    int start = 0;
+    int end = string->length;
+    while (start < end && isspace((unsigned char)string->chars[start]))
+        start++;
+    while (end > start && isspace((unsigned char)string->chars[end - 1]))
+        end--;
+
+    return OBJ_VAL(sliceString(string, start, end));
+}
+
+// split(string, separator) returns the pieces between separators as slices.
+// The separators are counted first, so the list is allocated at its final size.
+static Value splitNative(int argCount, Value *args)
+{
+    if (argCount != 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
+        NATIVE_ERROR("split() takes a string and a separator.");
+    if (AS_STRING(args[1])->length == 0)
+        NATIVE_ERROR("split() separator cannot be empty.");
+
+    ObjString *string = AS_STRING(args[0]);
+    ObjString *separator = AS_STRING(args[1]);
+    int count = countChars(string->chars, string->length, separator->chars, separator->length) + 1;
+
+    ObjList *list = newList();
+    push(OBJ_VAL(list));
+    if (heapProfiling)
+        profileObject(OBJ_LIST);
+    list->items = ALLOCATE(Value, count);
+    list->capacity = count;
+
+    // Slicing can collect and move the characters of a view, so the search
+    // goes by offset and re-reads them each time.
+    int start = 0;
+    for (int i = 0; i < count; i++)
     {
-        // Handle error
+        int end = string->length;
+        if (i < count - 1)
+            end = start + findChars(string->chars + start, string->length - start, separator->chars, separator->length);
+
+        appendToList(list, OBJ_VAL(sliceString(string, start, end)));
+        start = end + separator->length;
+    }
+
+    pop();
+    return OBJ_VAL(list);
+}
+
+// join(list, separator) concatenates a list of strings into one allocation of
+// exactly the right size.
+static Value joinNative(int argCount, Value *args)
+{
+    if (argCount != 2 || !IS_LIST(args[0]) || !IS_STRING(args[1]))
+        NATIVE_ERROR("join() takes a list of strings and a separator.");
+
+    ObjList *list = AS_LIST(args[0]);
+    ObjString *separator = AS_STRING(args[1]);
+    // Summed wide, since a list can repeat a long string many times.
+    int64_t wideLength = list->count > 0 ? (int64_t)separator->length * (list->count - 1) : 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (!IS_STRING(list->items[i]))
+            NATIVE_ERROR("join() can only join strings.");
+        wideLength += AS_STRING(list->items[i])->length;
+    }
+    if (wideLength > INT_MAX - 1)
+        NATIVE_ERROR("join() result is too long.");
+
+    int length = (int)wideLength;
+
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
+    char *chars = ALLOCATE(char, length + 1);
+
+    char *next = chars;
+    for (int i = 0; i < list->count; i++)
+    {
+        if (i > 0)
+        {
+            memcpy(next, separator->chars, separator->length);
+            next += separator->length;
+        }
+
+        ObjString *piece = AS_STRING(list->items[i]);
+        memcpy(next, piece->chars, piece->length);
+        next += piece->length;
+    }
+    chars[length] = '\0';
+
+    return OBJ_VAL(takeString(chars, length));
+}
+
+// replace(string, old, new) replaces every occurrence of old, sizing the result
+// from a first counting pass.
+static Value replaceNative(int argCount, Value *args)
+{
+    if (argCount != 3 || !IS_STRING(args[0]) || !IS_STRING(args[1]) || !IS_STRING(args[2]))
+        NATIVE_ERROR("replace() takes a string, a substring and its replacement.");
+    if (AS_STRING(args[1])->length == 0)
+        NATIVE_ERROR("replace() cannot replace an empty string.");
+
+    ObjString *string = AS_STRING(args[0]);
+    ObjString *from = AS_STRING(args[1]);
+    ObjString *to = AS_STRING(args[2]);
+    int count = countChars(string->chars, string->length, from->chars, from->length);
+    if (count == 0)
+        return args[0];
+
+    // Computed wide, since many long replacements can overflow an int.
+    int64_t wideLength = string->length + (int64_t)count * (to->length - from->length);
+    if (wideLength > INT_MAX - 1)
+        NATIVE_ERROR("replace() result is too long.");
+
+    int length = (int)wideLength;
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
+    char *chars = ALLOCATE(char, length + 1);
+
+    char *next = chars;
+    int start = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int found = start + findChars(string->chars + start, string->length - start, from->chars, from->length);
+        memcpy(next, string->chars + start, found - start);
+        next += found - start;
+        memcpy(next, to->chars, to->length);
+        next += to->length;
+        start = found + from->length;
     }
+    memcpy(next, string->chars + start, string->length - start);
+    chars[length] = '\0';
 
-    int len = IS_LIST(args[0]) ? AS_LIST(args[0])->count : AS_STRING(args[0])->length;
-    return NUMBER_VAL(len);
+    return OBJ_VAL(takeString(chars, length));
 }
 
 static Value appendNative(int argCount, Value *args)
 {
+    if (argCount != 2 || !(IS_LIST(args[0]) || IS_BUILDER(args[0])))
+        NATIVE_ERROR("append() takes a list or a builder and a value.");
+
     // Append a value to the end of a list increasing the list's length by 1
-    if (argCount != 2 || !IS_LIST(args[0]))
+    if (IS_LIST(args[0]))
     {
-        // Handle error
+        appendToList(AS_LIST(args[0]), args[1]);
+        return NONE_VAL;
     }
-    ObjList *list = AS_LIST(args[0]);
-    Value item = args[1];
-    appendToList(list, item);
+
+    if (!IS_STRING(args[1]) && !IS_BUILDER(args[1]))
+        NATIVE_ERROR("Can only append strings to a builder.");
+
+    appendToBuilder(AS_BUILDER(args[0]), args[1]);
+    return NONE_VAL;
+}
+
+// builder(pieces...) starts a mutable string, optionally with some text in it.
+static Value builderNative(int argCount, Value *args)
+{
+    for (int i = 0; i < argCount; i++)
+    {
+        if (!IS_STRING(args[i]) && !IS_BUILDER(args[i]))
+            NATIVE_ERROR("builder() takes strings.");
+    }
+
+    ObjBuilder *builder = newBuilder();
+    push(OBJ_VAL(builder));
+    for (int i = 0; i < argCount; i++)
+    {
+        appendToBuilder(builder, args[i]);
+    }
+    pop();
+    return OBJ_VAL(builder);
+}
+
+// build(builder) returns the text so far as an ordinary string.
+static Value buildNative(int argCount, Value *args)
+{
+    if (argCount != 1 || !IS_BUILDER(args[0]))
+        NATIVE_ERROR("build() takes a builder.");
+
+    return OBJ_VAL(buildString(AS_BUILDER(args[0])));
+}
+
+// Writes the heap profile so far, when running with --heap-profile.
+static Value heapProfileNative(int argCount, Value *args)
+{
+    (void)args;
+    if (argCount != 0)
+        NATIVE_ERROR("heap_profile() takes no arguments.");
+
+    if (heapProfiling)
+        printHeapProfile(stderr);
     return NONE_VAL;
 }
 
+// delete(list, index) removes an item; delete(dict, key) removes an entry.
 static Value deleteNative(int argCount, Value *args)
 {
-    // Delete an item from a list at the given index.
-    if (argCount != 2 || !IS_LIST(args[0]) || !IS_NUMBER(args[1]))
+    if (argCount == 2 && IS_DICT(args[0]))
     {
-        // Handle error
+        if (!dictDelete(AS_DICT(args[0]), args[1]))
+            NATIVE_ERROR("Key not found.");
+        return NONE_VAL;
     }
 
+    if (argCount != 2 || !IS_LIST(args[0]) || !IS_NUMBER(args[1]))
+        NATIVE_ERROR("delete() takes a list and an index or a dict and a key.");
+
     ObjList *list = AS_LIST(args[0]);
-    int index = AS_NUMBER(args[1]);
+    int64_t index = IS_INT(args[1]) ? AS_INT(args[1]) : (int64_t)AS_DOUBLE(args[1]);
 
     if (!isValidListIndex(list, index))
+        NATIVE_ERROR("List index out of range.");
+
+    deleteFromList(list, index);
+    return NONE_VAL;
+}
+
+// Reads a bitset size or bit position in [0, INT_MAX]. A double is truncated,
+// but only after checking it is finite and in range.
+static bool toBitIndex(Value value, int *result)
+{
+    if (IS_INT(value))
     {
-        // Handle error
+        if (AS_INT(value) < 0 || AS_INT(value) > INT_MAX)
+            return false;
+        *result = (int)AS_INT(value);
+        return true;
     }
 
-    deleteFromList(list, index);
+    if (!IS_DOUBLE(value) || !isfinite(AS_DOUBLE(value)) || AS_DOUBLE(value) < 0 ||
+        AS_DOUBLE(value) >= (double)INT_MAX + 1)
+        return false;
+
+    *result = (int)AS_DOUBLE(value);
+    return true;
+}
+
+// bitset(size) returns a bitset of `size` bits, all clear.
+static Value bitsetNative(int argCount, Value *args)
+{
+    int length;
+    if (argCount != 1 || !IS_NUMBER(args[0]))
+        NATIVE_ERROR("bitset() takes a size.");
+    if (!toBitIndex(args[0], &length) || length > INT_MAX - 63)
+        NATIVE_ERROR("Invalid bitset size.");
+
+    return OBJ_VAL(newBitset(length));
+}
+
+// Reads the arguments of fill() and clear(): a bitset and an optional range.
+static bool bitsetRange(int argCount, Value *args, int *start, int *end)
+{
+    if ((argCount != 1 && argCount != 3) || !IS_BITSET(args[0]))
+        return false;
+
+    int length = AS_BITSET(args[0])->length;
+    *start = 0;
+    *end = length;
+    if (argCount == 1)
+        return true;
+
+    return toBitIndex(args[1], start) && toBitIndex(args[2], end) && *start <= *end && *end <= length;
+}
+
+// fill(bitset) sets every bit, and fill(bitset, start, end) those in
+// [start, end). clear() does the opposite.
+static Value fillNative(int argCount, Value *args)
+{
+    int start, end;
+    if (!bitsetRange(argCount, args, &start, &end))
+        NATIVE_ERROR("fill() takes a bitset and an optional range within it.");
+
+    fillBitset(AS_BITSET(args[0]), start, end, true);
+    return NONE_VAL;
+}
+
+static Value clearNative(int argCount, Value *args)
+{
+    int start, end;
+    if (!bitsetRange(argCount, args, &start, &end))
+        NATIVE_ERROR("clear() takes a bitset and an optional range within it.");
+
+    fillBitset(AS_BITSET(args[0]), start, end, false);
     return NONE_VAL;
 }
 
+// next_set(bitset, index) returns the first set bit at or after index, or -1.
+static Value nextSetNative(int argCount, Value *args)
+{
+    int from;
+    if (argCount != 2 || !IS_BITSET(args[0]) || !toBitIndex(args[1], &from))
+        NATIVE_ERROR("next_set() takes a bitset and an index.");
+
+    return INT_VAL(nextSetBit(AS_BITSET(args[0]), from));
+}
+
+// keys(dict) and values(dict) return new lists, in no particular order, but
+// the same order for both while the dict is unchanged.
+static Value keysNative(int argCount, Value *args)
+{
+    if (argCount != 1 || !IS_DICT(args[0]))
+        NATIVE_ERROR("keys() takes a dict.");
+
+    return OBJ_VAL(dictKeys(AS_DICT(args[0])));
+}
+
+static Value valuesNative(int argCount, Value *args)
+{
+    if (argCount != 1 || !IS_DICT(args[0]))
+        NATIVE_ERROR("values() takes a dict.");
+
+    return OBJ_VAL(dictValues(AS_DICT(args[0])));
+}
+
 static void resetStack()
 {
     vm.stackTop = vm.stack;
     vm.frameCount = 0;
 }
 
+#define TRACE_FRAMES 16
+
 static void runtimeError(const char *format, ...)
 {
     va_list args;
@@ -105,10 +462,18 @@ static void runtimeError(const char *format, ...)
 
     for (int i = vm.frameCount - 1; i >= 0; i--)
     {
+        // Deep recursion would bury the message, so only the ends of a long
+        // trace are shown.
+        if (i == vm.frameCount - 1 - TRACE_FRAMES && i >= TRACE_FRAMES)
+        {
+            fprintf(stderr, "... %d more frames ...\n", i - TRACE_FRAMES + 1);
+            i = TRACE_FRAMES - 1;
+        }
+
         CallFrame *frame = &vm.frames[i];
         ObjFunction *function = frame->function;
         size_t instruction = frame->ip - function->chunk.code - 1;
-        fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
+        fprintf(stderr, "[line %d] in ", getLine(&function->chunk, (int)instruction));
 
         if (function->name == NULL)
         {
@@ -123,22 +488,58 @@ static void runtimeError(const char *format, ...)
     resetStack();
 }
 
+int globalSlot(ObjString *name)
+{
+    Value index;
+    if (tableGet(&vm.globalSlots, name, &index))
+        return (int)AS_INT(index);
+
+    int slot = vm.globalValues.count;
+    push(OBJ_VAL(name));
+    writeValueArray(&vm.globalNames, OBJ_VAL(name));
+    writeValueArray(&vm.globalValues, UNDEFINED_VAL);
+    tableSet(&vm.globalSlots, name, INT_VAL(slot));
+    pop();
+    return slot;
+}
+
 static void defineNative(const char *name, NativeFn function)
 {
     push(OBJ_VAL(copyString(name, (int)strlen(name))));
     push(OBJ_VAL(newNative(function)));
-    tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
+    int slot = globalSlot(AS_STRING(vm.stack[0]));
+    vm.globalValues.values[slot] = vm.stack[1];
     pop();
     pop();
 }
 
 void initVM()
 {
-    resetStack();
     vm.objects = NULL;
-
-    initTable(&vm.globals);
+    vm.oldObjects = NULL;
+    vm.sweepObjects = NULL;
+    vm.bytesAllocated = 0;
+    vm.nextGC = GC_MIN_HEAP;
+    vm.nurseryLimit = GC_NURSERY_SIZE;
+    vm.gcPhase = GC_IDLE;
+    vm.collectingYoung = false;
+    vm.youngGray = (ObjStack){0, 0, NULL};
+    vm.oldGray = (ObjStack){0, 0, NULL};
+    vm.remembered = (ObjStack){0, 0, NULL};
+    vm.views = (ObjStack){0, 0, NULL};
+
+    initTable(&vm.globalSlots);
+    initValueArray(&vm.globalNames);
+    initValueArray(&vm.globalValues);
     initTable(&vm.strings);
+    memset(vm.tinyStrings, 0, sizeof(vm.tinyStrings));
+
+    vm.frameCapacity = FRAMES_INITIAL < FRAMES_MAX ? FRAMES_INITIAL : FRAMES_MAX;
+    vm.frames = ALLOCATE(CallFrame, vm.frameCapacity);
+    vm.stackCapacity = STACK_INITIAL;
+    vm.stack = ALLOCATE(Value, vm.stackCapacity);
+    resetStack();
+    initCharStrings();
 
     defineNative("print", printNative);
     defineNative("input", inputNative);
@@ -146,13 +547,35 @@ void initVM()
     defineNative("len", lenNative);
     defineNative("append", appendNative);
     defineNative("delete", deleteNative);
+    defineNative("builder", builderNative);
+    defineNative("build", buildNative);
+    defineNative("heap_profile", heapProfileNative);
+    defineNative("find", findNative);
+    defineNative("count", countNative);
+    defineNative("startswith", startswithNative);
+    defineNative("strip", stripNative);
+    defineNative("split", splitNative);
+    defineNative("join", joinNative);
+    defineNative("replace", replaceNative);
+    defineNative("keys", keysNative);
+    defineNative("values", valuesNative);
+    defineNative("bitset", bitsetNative);
+    defineNative("fill", fillNative);
+    defineNative("clear", clearNative);
+    defineNative("next_set", nextSetNative);
 }
 
 void freeVM()
 {
-    freeTable(&vm.globals);
+    freeTable(&vm.globalSlots);
+    freeValueArray(&vm.globalNames);
+    freeValueArray(&vm.globalValues);
     freeTable(&vm.strings);
     freeObjects();
+    FREE_ARRAY(CallFrame, vm.frames, vm.frameCapacity);
+    FREE_ARRAY(Value, vm.stack, vm.stackCapacity);
+    freeSlabs();
+    freeHeapProfile();
 }
 
 void push(Value value)
@@ -172,6 +595,40 @@ static Value peek(int distance)
     return vm.stackTop[-1 - distance];
 }
 
+// Moves the value stack to a larger allocation of at least `needed` slots and
+// rebases every pointer into it.
+static void growStack(int needed)
+{
+    int capacity = vm.stackCapacity;
+    while (capacity < needed)
+        capacity *= 2;
+
+    Value *stack = ALLOCATE(Value, capacity);
+    memcpy(stack, vm.stack, sizeof(Value) * (vm.stackTop - vm.stack));
+
+    for (int i = 0; i < vm.frameCount; i++)
+        vm.frames[i].slots = stack + (vm.frames[i].slots - vm.stack);
+    vm.stackTop = stack + (vm.stackTop - vm.stack);
+
+    FREE_ARRAY(Value, vm.stack, vm.stackCapacity);
+    vm.stack = stack;
+    vm.stackCapacity = capacity;
+}
+
+static bool growFrames()
+{
+    if (vm.frameCapacity == FRAMES_MAX)
+    {
+        runtimeError("Stack overflow.");
+        return false;
+    }
+
+    int capacity = vm.frameCapacity * 2 < FRAMES_MAX ? vm.frameCapacity * 2 : FRAMES_MAX;
+    vm.frames = GROW_ARRAY(CallFrame, vm.frames, vm.frameCapacity, capacity);
+    vm.frameCapacity = capacity;
+    return true;
+}
+
 static bool call(ObjFunction *function, int argCount)
 {
     if (argCount != function->arity)
@@ -180,16 +637,22 @@ static bool call(ObjFunction *function, int argCount)
         return false;
     }
 
-    if (vm.frameCount == FRAMES_MAX)
-    {
-        runtimeError("Stack overflow.");
+    if (vm.frameCount == vm.frameCapacity && !growFrames())
         return false;
+
+    // The compiler records how deep each function can take the stack, so one
+    // check here covers every push the callee makes.
+    Value *slots = vm.stackTop - argCount - 1;
+    if (function->stackSize > vm.stackCapacity - (int)(slots - vm.stack))
+    {
+        growStack((int)(slots - vm.stack) + function->stackSize);
+        slots = vm.stackTop - argCount - 1;
     }
 
     CallFrame *frame = &vm.frames[vm.frameCount++];
     frame->function = function;
     frame->ip = function->chunk.code;
-    frame->slots = vm.stackTop - argCount - 1;
+    frame->slots = slots;
     return true;
 }
 
@@ -204,6 +667,11 @@ static bool callValue(Value callee, int argCount)
         case OBJ_NATIVE: {
             NativeFn native = AS_NATIVE(callee);
             Value result = native(argCount, vm.stackTop - argCount);
+            if (nativeFailed)
+            {
+                nativeFailed = false;
+                return false;
+            }
             vm.stackTop -= argCount + 1;
             push(result);
             return true;
@@ -219,30 +687,210 @@ static bool callValue(Value callee, int argCount)
 
 static bool isFalsey(Value value)
 {
-    return IS_NONE(value) || (IS_BOOL(value) && !AS_BOOL(value)) || (IS_NUMBER(value) && !AS_NUMBER(value)) ||
-           (IS_STRING(value) && !AS_STRING(value)->length) || (IS_LIST(value) && !AS_LIST(value)->count);
+    if (IS_BOOL(value))
+        return !AS_BOOL(value);
+    if (IS_INT(value))
+        return AS_INT(value) == 0;
+
+    return IS_NONE(value) || (IS_DOUBLE(value) && !AS_DOUBLE(value)) ||
+           (IS_STRING(value) && !AS_STRING(value)->length) || (IS_LIST(value) && !AS_LIST(value)->count) ||
+           (IS_DICT(value) && !AS_DICT(value)->count);
 }
 
+// Converts an int, or a double with no fractional part, to an int64_t.
+static bool toInteger(Value value, int64_t *result)
+{
+    if (IS_INT(value))
+    {
+        *result = AS_INT(value);
+        return true;
+    }
+
+    if (!IS_DOUBLE(value) || !isInt(AS_DOUBLE(value)))
+        return false;
+
+    *result = (int64_t)AS_DOUBLE(value);
+    return true;
+}
+
+// These helpers leave their operands on the stack until the result exists,
+// so a collection triggered while building it cannot free them.
 static void concatenate()
 {
-    ObjString *b = AS_STRING(pop());
-    ObjString *a = AS_STRING(pop());
+    ObjString *b = AS_STRING(peek(0));
+    ObjString *a = AS_STRING(peek(1));
 
     int length = a->length + b->length;
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
     char *chars = ALLOCATE(char, length + 1);
     memcpy(chars, a->chars, a->length);
     memcpy(chars + a->length, b->chars, b->length);
     chars[length] = '\0';
 
     ObjString *result = takeString(chars, length);
+    pop();
+    pop();
     push(OBJ_VAL(result));
 }
 
+static bool indexValue(Value collection, Value v_index, Value *result)
+{
+    if (IS_DICT(collection))
+    {
+        if (!dictGet(AS_DICT(collection), v_index, result))
+        {
+            runtimeError("Key not found.");
+            return false;
+        }
+        return true;
+    }
+
+    if (!IS_LIST(collection) && !IS_STRING(collection) && !IS_BITSET(collection))
+    {
+        runtimeError("Invalid type to index into.");
+        return false;
+    }
+
+    if (!IS_NUMBER(v_index))
+    {
+        runtimeError("Index is not a number.");
+        return false;
+    }
+
+    int64_t index = IS_INT(v_index) ? AS_INT(v_index) : (int64_t)AS_DOUBLE(v_index);
+
+    if (IS_STRING(collection))
+    {
+        ObjString *str = AS_STRING(collection);
+
+        if (!isValidStringIndex(str, index))
+        {
+            runtimeError("String index out of range.");
+            return false;
+        }
+
+        *result = indexFromString(str, index);
+    }
+    else if (IS_BITSET(collection))
+    {
+        ObjBitset *bitset = AS_BITSET(collection);
+
+        if (index < -bitset->length || index >= bitset->length)
+        {
+            runtimeError("Bitset index out of range.");
+            return false;
+        }
+
+        *result = BOOL_VAL(bitsetGet(bitset, (index < 0) * bitset->length + index));
+    }
+    else
+    {
+        ObjList *list = AS_LIST(collection);
+
+        if (!isValidListIndex(list, index))
+        {
+            runtimeError("List index out of range.");
+            return false;
+        }
+
+        *result = indexFromList(list, index);
+    }
+
+    return true;
+}
+
+// Resolves a slice bound like an index, counting negative ones from the end,
+// then clamps it to [0, length]. None stands for `fallback`.
+static bool sliceBound(Value bound, int length, int fallback, int *result)
+{
+    if (IS_NONE(bound))
+    {
+        *result = fallback;
+        return true;
+    }
+
+    if (!IS_NUMBER(bound))
+    {
+        runtimeError("Slice index is not a number.");
+        return false;
+    }
+
+    int64_t index = IS_INT(bound) ? AS_INT(bound) : (int64_t)AS_DOUBLE(bound);
+    if (index < 0)
+        index += length;
+
+    *result = index < 0 ? 0 : index > length ? length : (int)index;
+    return true;
+}
+
+// The operands must stay on the stack, since the slice may allocate.
+static bool sliceValue(Value collection, Value v_start, Value v_end, Value *result)
+{
+    if (!IS_LIST(collection) && !IS_STRING(collection))
+    {
+        runtimeError("Invalid type to slice.");
+        return false;
+    }
+
+    int length = IS_LIST(collection) ? AS_LIST(collection)->count : AS_STRING(collection)->length;
+    int start, end;
+    if (!sliceBound(v_start, length, 0, &start) || !sliceBound(v_end, length, length, &end))
+        return false;
+
+    if (IS_STRING(collection))
+        *result = OBJ_VAL(sliceString(AS_STRING(collection), start, end));
+    else
+        *result = OBJ_VAL(sliceList(AS_LIST(collection), start, end));
+    return true;
+}
+
+// Implements `item in container`: a substring test on strings, a search by
+// equality on lists and a key lookup on dicts.
+static bool containsValue(Value container, Value item, bool *result)
+{
+    if (IS_STRING(container))
+    {
+        if (!IS_STRING(item))
+        {
+            runtimeError("Can only search a string for a string.");
+            return false;
+        }
+
+        ObjString *string = AS_STRING(container);
+        ObjString *sub = AS_STRING(item);
+        *result = findChars(string->chars, string->length, sub->chars, sub->length) >= 0;
+        return true;
+    }
+
+    if (IS_DICT(container))
+    {
+        Value value;
+        *result = dictGet(AS_DICT(container), item, &value);
+        return true;
+    }
+
+    if (!IS_LIST(container))
+    {
+        runtimeError("Invalid type to search in.");
+        return false;
+    }
+
+    ObjList *list = AS_LIST(container);
+    *result = false;
+    for (int i = 0; i < list->count && !*result; i++)
+    {
+        *result = valuesEqual(list->items[i], item);
+    }
+    return true;
+}
+
 static void concat_list()
 {
-    ObjList *b = AS_LIST(pop());
-    ObjList *a = AS_LIST(pop());
+    ObjList *b = AS_LIST(peek(0));
+    ObjList *a = AS_LIST(peek(1));
     ObjList *result = newList();
+    push(OBJ_VAL(result));
 
     for (int i = 0; i < a->count; i++)
         appendToList(result, a->items[i]);
@@ -250,32 +898,68 @@ static void concat_list()
     for (int i = 0; i < b->count; i++)
         appendToList(result, b->items[i]);
 
+    vm.stackTop -= 3;
     push(OBJ_VAL(result));
 }
 
-static bool scaler_str_mul()
+// Implements &, | and ^ on two bitsets of the same length.
+static bool combineValues(BitsetOp op)
 {
-    double num;
-    ObjString *str;
+    if (!IS_BITSET(peek(0)) || !IS_BITSET(peek(1)))
+    {
+        runtimeError("Operands must be two numbers or two bitsets.");
+        return false;
+    }
 
-    if (IS_STRING(peek(0)))
+    int length = AS_BITSET(peek(0))->length;
+    if (AS_BITSET(peek(1))->length != length)
     {
-        str = AS_STRING(pop());
-        num = AS_NUMBER(pop());
+        runtimeError("Bitsets must have the same length.");
+        return false;
+    }
+
+    ObjBitset *result = newBitset(length);
+    combineBitsets(result, AS_BITSET(peek(1)), AS_BITSET(peek(0)), op);
+    vm.stackTop -= 2;
+    push(OBJ_VAL(result));
+    return true;
+}
+
+static bool concatenateValues()
+{
+    if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
+    {
+        concatenate();
+    }
+    else if (IS_LIST(peek(0)) && IS_LIST(peek(1)))
+    {
+        concat_list();
     }
     else
     {
-        num = AS_NUMBER(pop());
-        str = AS_STRING(pop());
+        runtimeError("Operands must be two numbers or two strings or two list.");
+        return false;
     }
 
-    if (!isInt(num))
+    return true;
+}
+
+static bool scaler_str_mul()
+{
+    bool strOnTop = IS_STRING(peek(0));
+    ObjString *str = AS_STRING(peek(strOnTop ? 0 : 1));
+    Value count = peek(strOnTop ? 1 : 0);
+
+    int64_t num;
+    if (!toInteger(count, &num))
     {
         runtimeError("Strings must be multiplied with integer only.");
         return false;
     }
 
     int length = str->length * num;
+    if (heapProfiling)
+        profileObject(OBJ_STRING);
     char *chars = ALLOCATE(char, length + 1);
 
     for (int i = 0; i < num; i++)
@@ -284,27 +968,20 @@ static bool scaler_str_mul()
     chars[length] = '\0';
 
     ObjString *result = takeString(chars, length);
+    pop();
+    pop();
     push(OBJ_VAL(result));
     return true;
 }
 
 static bool scaler_list_mul()
 {
-    double num;
-    ObjList *list;
-
-    if (IS_STRING(peek(0)))
-    {
-        list = AS_LIST(pop());
-        num = AS_NUMBER(pop());
-    }
-    else
-    {
-        num = AS_NUMBER(pop());
-        list = AS_LIST(pop());
-    }
+    bool listOnTop = IS_LIST(peek(0));
+    ObjList *list = AS_LIST(peek(listOnTop ? 0 : 1));
+    Value count = peek(listOnTop ? 1 : 0);
 
-    if (!isInt(num))
+    int64_t num;
+    if (!toInteger(count, &num))
     {
         runtimeError("Lists must be multiplied with integer only.");
         return false;
@@ -312,10 +989,12 @@ static bool scaler_list_mul()
 
     int length = list->count * num;
     ObjList *result = newList();
+    push(OBJ_VAL(result));
 
     for (int i = 0; i < length; i++)
         appendToList(result, list->items[i % list->count]);
 
+    vm.stackTop -= 3;
     push(OBJ_VAL(result));
     return true;
 }
@@ -325,400 +1004,1058 @@ inline static double mod(double x, double y)
     return x - y * floor(x / y);
 }
 
+// Integer arithmetic on int Values. Each helper returns false when the exact
+// result does not fit in an int Value, and the caller falls back to doubles.
+inline static bool addInts(int64_t a, int64_t b, int64_t *result)
+{
+#ifdef __GNUC__
+    if (__builtin_add_overflow(a, b, result))
+        return false;
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        return false;
+    *result = a + b;
+#endif
+    return INT_FITS(*result);
+}
+
+inline static bool subtractInts(int64_t a, int64_t b, int64_t *result)
+{
+#ifdef __GNUC__
+    if (__builtin_sub_overflow(a, b, result))
+        return false;
+#else
+    if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+        return false;
+    *result = a - b;
+#endif
+    return INT_FITS(*result);
+}
+
+inline static bool multiplyInts(int64_t a, int64_t b, int64_t *result)
+{
+#ifdef __GNUC__
+    if (__builtin_mul_overflow(a, b, result))
+        return false;
+#else
+    if (fabs((double)a * (double)b) >= 0x1p62)
+        return false;
+    *result = a * b;
+#endif
+    return INT_FITS(*result);
+}
+
+inline static Value intOrDouble(int64_t value)
+{
+    return INT_FITS(value) ? INT_VAL(value) : NUMBER_VAL((double)value);
+}
+
+// The operands of these are already known to be numbers.
+inline static Value addNumbers(Value a, Value b)
+{
+    int64_t result;
+    if (BOTH_INTS(a, b) && addInts(AS_INT(a), AS_INT(b), &result))
+        return INT_VAL(result);
+    if (BOTH_DOUBLES(a, b))
+        return NUMBER_VAL(AS_DOUBLE(a) + AS_DOUBLE(b));
+    return NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b));
+}
+
+inline static Value subtractNumbers(Value a, Value b)
+{
+    int64_t result;
+    if (BOTH_INTS(a, b) && subtractInts(AS_INT(a), AS_INT(b), &result))
+        return INT_VAL(result);
+    if (BOTH_DOUBLES(a, b))
+        return NUMBER_VAL(AS_DOUBLE(a) - AS_DOUBLE(b));
+    return NUMBER_VAL(AS_NUMBER(a) - AS_NUMBER(b));
+}
+
+inline static Value multiplyNumbers(Value a, Value b)
+{
+    int64_t result;
+    if (BOTH_INTS(a, b) && multiplyInts(AS_INT(a), AS_INT(b), &result))
+        return INT_VAL(result);
+    if (BOTH_DOUBLES(a, b))
+        return NUMBER_VAL(AS_DOUBLE(a) * AS_DOUBLE(b));
+    return NUMBER_VAL(AS_NUMBER(a) * AS_NUMBER(b));
+}
+
+inline static Value divideNumbers(Value a, Value b)
+{
+    return NUMBER_VAL(AS_NUMBER(a) / AS_NUMBER(b));
+}
+
+static Value floorDivideNumbers(Value a, Value b)
+{
+    if (BOTH_INTS(a, b) && AS_INT(b) != 0 && !(AS_INT(a) == INT64_MIN && AS_INT(b) == -1))
+    {
+        int64_t x = AS_INT(a), y = AS_INT(b);
+        int64_t quotient = x / y;
+        if (x % y != 0 && (x < 0) != (y < 0))
+            quotient--;
+        return intOrDouble(quotient);
+    }
+    return NUMBER_VAL(floor(AS_NUMBER(a) / AS_NUMBER(b)));
+}
+
+static Value moduloNumbers(Value a, Value b)
+{
+    if (BOTH_INTS(a, b) && AS_INT(b) != 0)
+    {
+        int64_t x = AS_INT(a), y = AS_INT(b);
+        if (y == -1)
+            return INT_VAL(0);
+        int64_t remainder = x % y;
+        if (remainder != 0 && (remainder < 0) != (y < 0))
+            remainder += y;
+        return INT_VAL(remainder);
+    }
+    return NUMBER_VAL(mod(AS_NUMBER(a), AS_NUMBER(b)));
+}
+
+static Value powerNumbers(Value a, Value b)
+{
+    if (BOTH_INTS(a, b) && AS_INT(b) >= 0)
+    {
+        int64_t base = AS_INT(a), exponent = AS_INT(b), result = 1;
+        bool fits = true;
+        while (fits && exponent > 0)
+        {
+            if (exponent & 1)
+                fits = multiplyInts(result, base, &result);
+            exponent >>= 1;
+            if (fits && exponent > 0)
+                fits = multiplyInts(base, base, &base);
+        }
+        if (fits)
+            return INT_VAL(result);
+    }
+    return NUMBER_VAL(pow(AS_NUMBER(a), AS_NUMBER(b)));
+}
+
+static Value shiftLeft(int64_t a, int64_t b)
+{
+    if (a == 0)
+        return INT_VAL(0);
+    if (b >= 63 || a > (INT64_MAX >> b) || a < (INT64_MIN >> b))
+        return NUMBER_VAL(ldexp((double)a, b > 2048 ? 2048 : (int)b));
+    return intOrDouble((int64_t)((uint64_t)a << b));
+}
+
+static Value shiftRight(int64_t a, int64_t b)
+{
+    if (b >= 64)
+        return INT_VAL(a < 0 ? -1 : 0);
+    return INT_VAL(a >> b);
+}
+
+#ifdef DEBUG_TRACE_EXECUTION
+static void traceExecution(CallFrame *frame, uint8_t *ip, Value *sp)
+{
+    printf("          ");
+    for (Value *slot = vm.stack; slot < sp; slot++)
+    {
+        printf("[ ");
+        printValue(*slot);
+        printf(" ]");
+    }
+    printf("\n");
+    disassembleInstruction(&frame->function->chunk, (int)(ip - frame->function->chunk.code));
+}
+#endif
+
 static InterpretResult run()
 {
-    CallFrame *frame = &vm.frames[vm.frameCount - 1];
+    // The hot interpreter state lives in locals so the compiler can keep it in
+    // registers. It is written back to the frame and vm.stackTop only before
+    // anything that reads it from there: calls, returns, helpers that use the
+    // VM stack and runtime errors.
+    CallFrame *frame;
+    uint8_t *ip;
+    Value *sp;
+    Value *slots;
+    Value *constants;
+
+#define LOAD_FRAME()                                                                                                   \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        frame = &vm.frames[vm.frameCount - 1];                                                                         \
+        ip = frame->ip;                                                                                                \
+        slots = frame->slots;                                                                                          \
+        constants = frame->function->chunk.constants.values;                                                           \
+        sp = vm.stackTop;                                                                                              \
+    } while (false)
+#define STORE_FRAME()                                                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        frame->ip = ip;                                                                                                \
+        vm.stackTop = sp;                                                                                              \
+    } while (false)
+#define RUNTIME_ERROR(...)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        STORE_FRAME();                                                                                                 \
+        runtimeError(__VA_ARGS__);                                                                                     \
+        return INTERPRET_RUNTIME_ERROR;                                                                                \
+    } while (false)
+
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define DROP() (sp--)
+#define PEEK(distance) (sp[-1 - (distance)])
 
-#define READ_BYTE() (*frame->ip++)
-#define READ_SHORT() (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-#define READ_CONSTANT() (frame->function->chunk.constants.values[READ_BYTE()])
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_LONG() (ip += 3, (ip[-3] << 16) | (ip[-2] << 8) | ip[-1])
+#define READ_CONSTANT() (constants[READ_BYTE()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
-#define BINARY_OP(valueType, op)                                                                                       \
+
+// Quickening: a generic handler that saw the operand types its specialized
+// variant expects rewrites its own opcode in place. The specialized handler
+// checks the types once and, if they changed, restores the generic opcode
+// and re-executes the instruction through it. It is a bare block rather
+// than do/while because DISPATCH() may be a `continue`.
+#define QUICKEN(specialized) (ip[-1] = (specialized))
+#define DEOPTIMIZE(generic)                                                                                            \
+    {                                                                                                                  \
+        *--ip = (generic);                                                                                             \
+        DISPATCH();                                                                                                    \
+    }
+#define BINARY_OP(function)                                                                                            \
     do                                                                                                                 \
     {                                                                                                                  \
-        if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))                                                                \
+        Value b = PEEK(0);                                                                                             \
+        Value a = PEEK(1);                                                                                             \
+        if (!BOTH_INTS(a, b) && !BOTH_DOUBLES(a, b) && (!IS_NUMBER(a) || !IS_NUMBER(b)))                               \
         {                                                                                                              \
-            runtimeError("Operands must be numbers.");                                                                 \
-            return INTERPRET_RUNTIME_ERROR;                                                                            \
+            RUNTIME_ERROR("Operands must be numbers.");                                                                \
         }                                                                                                              \
-        double b = AS_NUMBER(pop());                                                                                   \
-        double a = AS_NUMBER(pop());                                                                                   \
-        push(valueType(a op b));                                                                                       \
+        DROP();                                                                                                        \
+        PEEK(0) = function(a, b);                                                                                      \
     } while (false)
-#define BITWISE_OP(valueType, op)                                                                                      \
+#define COMPARE_OP(op)                                                                                                 \
     do                                                                                                                 \
     {                                                                                                                  \
-        if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))                                                                \
+        Value b = PEEK(0);                                                                                             \
+        Value a = PEEK(1);                                                                                             \
+        bool result;                                                                                                   \
+        if (BOTH_INTS(a, b))                                                                                           \
+            result = AS_INT(a) op AS_INT(b);                                                                           \
+        else if (BOTH_DOUBLES(a, b))                                                                                   \
+            result = AS_DOUBLE(a) op AS_DOUBLE(b);                                                                     \
+        else if (IS_NUMBER(a) && IS_NUMBER(b))                                                                         \
+            result = AS_NUMBER(a) op AS_NUMBER(b);                                                                     \
+        else                                                                                                           \
         {                                                                                                              \
-            runtimeError("Operands must be numbers.");                                                                 \
-            return INTERPRET_RUNTIME_ERROR;                                                                            \
+            RUNTIME_ERROR("Operands must be numbers.");                                                                \
+        }                                                                                                              \
+        DROP();                                                                                                        \
+        PEEK(0) = BOOL_VAL(result);                                                                                    \
+    } while (false)
+#define BITWISE_OP(result)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!IS_NUMBER(PEEK(0)) || !IS_NUMBER(PEEK(1)))                                                                \
+        {                                                                                                              \
+            RUNTIME_ERROR("Operands must be numbers.");                                                                \
         }                                                                                                              \
-        double b = AS_NUMBER(pop());                                                                                   \
-        double a = AS_NUMBER(pop());                                                                                   \
-        if (!isInt(a) || !isInt(b))                                                                                    \
+        int64_t a, b;                                                                                                  \
+        if (!toInteger(PEEK(1), &a) || !toInteger(PEEK(0), &b))                                                        \
         {                                                                                                              \
-            runtimeError("Numbers must be of integer type.");                                                          \
+            RUNTIME_ERROR("Numbers must be of integer type.");                                                         \
+        }                                                                                                              \
+        DROP();                                                                                                        \
+        PEEK(0) = result;                                                                                              \
+    } while (false)
+#define BITSET_OP(op)                                                                                                  \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        STORE_FRAME();                                                                                                 \
+        if (!combineValues(op))                                                                                        \
             return INTERPRET_RUNTIME_ERROR;                                                                            \
+        sp = vm.stackTop;                                                                                              \
+    } while (false)
+#define COMPARE_JUMP(op, jumpWhen)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        uint16_t offset = READ_SHORT();                                                                                \
+        Value b = PEEK(0);                                                                                             \
+        Value a = PEEK(1);                                                                                             \
+        bool result;                                                                                                   \
+        if (BOTH_INTS(a, b))                                                                                           \
+            result = AS_INT(a) op AS_INT(b);                                                                           \
+        else if (BOTH_DOUBLES(a, b))                                                                                   \
+            result = AS_DOUBLE(a) op AS_DOUBLE(b);                                                                     \
+        else if (IS_NUMBER(a) && IS_NUMBER(b))                                                                         \
+            result = AS_NUMBER(a) op AS_NUMBER(b);                                                                     \
+        else                                                                                                           \
+        {                                                                                                              \
+            RUNTIME_ERROR("Operands must be numbers.");                                                                \
         }                                                                                                              \
-        push(valueType((int)a op(int) b));                                                                             \
+        sp -= 2;                                                                                                       \
+        if (result == jumpWhen)                                                                                        \
+            ip += offset;                                                                                              \
     } while (false)
 
-    for (;;)
-    {
 #ifdef DEBUG_TRACE_EXECUTION
-        printf("          ");
-        for (Value *slot = vm.stack; slot < vm.stackTop; slot++)
-        {
-            printf("[ ");
-            printValue(*slot);
-            printf(" ]");
-        }
-        printf("\n");
-        disassembleInstruction(&frame->function->chunk, (int)(frame->ip - frame->function->chunk.code));
+#define TRACE_EXECUTION() traceExecution(frame, ip, sp)
+#else
+#define TRACE_EXECUTION() ((void)0)
 #endif
 
-        uint8_t instruction;
-        switch (instruction = READ_BYTE())
-        {
-        case OP_CONSTANT: {
+#ifdef COMPUTED_GOTO
+    static void *dispatchTable[] = {
+        [OP_CONSTANT] = &&TARGET_OP_CONSTANT,
+        [OP_NONE] = &&TARGET_OP_NONE,
+        [OP_TRUE] = &&TARGET_OP_TRUE,
+        [OP_FALSE] = &&TARGET_OP_FALSE,
+        [OP_POP] = &&TARGET_OP_POP,
+        [OP_GET_LOCAL] = &&TARGET_OP_GET_LOCAL,
+        [OP_SET_LOCAL] = &&TARGET_OP_SET_LOCAL,
+        [OP_GET_GLOBAL] = &&TARGET_OP_GET_GLOBAL,
+        [OP_DEFINE_GLOBAL] = &&TARGET_OP_DEFINE_GLOBAL,
+        [OP_SET_GLOBAL] = &&TARGET_OP_SET_GLOBAL,
+        [OP_BUILD_LIST] = &&TARGET_OP_BUILD_LIST,
+        [OP_BUILD_DICT] = &&TARGET_OP_BUILD_DICT,
+        [OP_INDEX_SUBSCR] = &&TARGET_OP_INDEX_SUBSCR,
+        [OP_STORE_SUBSCR] = &&TARGET_OP_STORE_SUBSCR,
+        [OP_SLICE] = &&TARGET_OP_SLICE,
+        [OP_EQUAL] = &&TARGET_OP_EQUAL,
+        [OP_GREATER] = &&TARGET_OP_GREATER,
+        [OP_LESS] = &&TARGET_OP_LESS,
+        [OP_IN] = &&TARGET_OP_IN,
+        [OP_ADD] = &&TARGET_OP_ADD,
+        [OP_SUBTRACT] = &&TARGET_OP_SUBTRACT,
+        [OP_MULTIPLY] = &&TARGET_OP_MULTIPLY,
+        [OP_DIVIDE] = &&TARGET_OP_DIVIDE,
+        [OP_INTDIV] = &&TARGET_OP_INTDIV,
+        [OP_MOD] = &&TARGET_OP_MOD,
+        [OP_POW] = &&TARGET_OP_POW,
+        [OP_NOT] = &&TARGET_OP_NOT,
+        [OP_NEGATE] = &&TARGET_OP_NEGATE,
+        [OP_BAND] = &&TARGET_OP_BAND,
+        [OP_BOR] = &&TARGET_OP_BOR,
+        [OP_XOR] = &&TARGET_OP_XOR,
+        [OP_BNOT] = &&TARGET_OP_BNOT,
+        [OP_LSHIFT] = &&TARGET_OP_LSHIFT,
+        [OP_RSHIFT] = &&TARGET_OP_RSHIFT,
+        [OP_JUMP] = &&TARGET_OP_JUMP,
+        [OP_JUMP_IF_FALSE] = &&TARGET_OP_JUMP_IF_FALSE,
+        [OP_LOOP] = &&TARGET_OP_LOOP,
+        [OP_CALL] = &&TARGET_OP_CALL,
+        [OP_TAIL_CALL] = &&TARGET_OP_TAIL_CALL,
+        [OP_RETURN] = &&TARGET_OP_RETURN,
+        [OP_CONSTANT_LONG] = &&TARGET_OP_CONSTANT_LONG,
+        [OP_GET_LOCAL_LONG] = &&TARGET_OP_GET_LOCAL_LONG,
+        [OP_SET_LOCAL_LONG] = &&TARGET_OP_SET_LOCAL_LONG,
+        [OP_GET_GLOBAL_LONG] = &&TARGET_OP_GET_GLOBAL_LONG,
+        [OP_DEFINE_GLOBAL_LONG] = &&TARGET_OP_DEFINE_GLOBAL_LONG,
+        [OP_SET_GLOBAL_LONG] = &&TARGET_OP_SET_GLOBAL_LONG,
+        [OP_BUILD_LIST_LONG] = &&TARGET_OP_BUILD_LIST_LONG,
+        [OP_BUILD_DICT_LONG] = &&TARGET_OP_BUILD_DICT_LONG,
+        [OP_JUMP_IF_NOT_EQUAL] = &&TARGET_OP_JUMP_IF_NOT_EQUAL,
+        [OP_JUMP_IF_EQUAL] = &&TARGET_OP_JUMP_IF_EQUAL,
+        [OP_JUMP_IF_NOT_GREATER] = &&TARGET_OP_JUMP_IF_NOT_GREATER,
+        [OP_JUMP_IF_GREATER] = &&TARGET_OP_JUMP_IF_GREATER,
+        [OP_JUMP_IF_NOT_LESS] = &&TARGET_OP_JUMP_IF_NOT_LESS,
+        [OP_JUMP_IF_LESS] = &&TARGET_OP_JUMP_IF_LESS,
+        [OP_INCR_LOCAL] = &&TARGET_OP_INCR_LOCAL,
+        [OP_ADD_LOCALS] = &&TARGET_OP_ADD_LOCALS,
+        [OP_INDEX_SUBSCR2] = &&TARGET_OP_INDEX_SUBSCR2,
+        [OP_ADD_INT] = &&TARGET_OP_ADD_INT,
+        [OP_ADD_DOUBLE] = &&TARGET_OP_ADD_DOUBLE,
+        [OP_MULTIPLY_INT] = &&TARGET_OP_MULTIPLY_INT,
+        [OP_MULTIPLY_DOUBLE] = &&TARGET_OP_MULTIPLY_DOUBLE,
+        [OP_INDEX_LIST_INT] = &&TARGET_OP_INDEX_LIST_INT,
+        [OP_INDEX2_LIST_INT] = &&TARGET_OP_INDEX2_LIST_INT,
+        [OP_STORE_LIST_INT] = &&TARGET_OP_STORE_LIST_INT,
+        [OP_INDEX_BITSET_INT] = &&TARGET_OP_INDEX_BITSET_INT,
+        [OP_STORE_BITSET_INT] = &&TARGET_OP_STORE_BITSET_INT,
+    };
+
+    // Every handler ends in its own indirect jump, so the branch predictor
+    // learns opcode-to-opcode transitions instead of one shared switch.
+#define INTERPRET_LOOP DISPATCH();
+#define CASE(op) TARGET_##op
+#define DISPATCH()                                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        TRACE_EXECUTION();                                                                                             \
+        goto *dispatchTable[instruction = READ_BYTE()];                                                                \
+    } while (false)
+#else
+#define INTERPRET_LOOP                                                                                                 \
+    for (;;)                                                                                                           \
+    switch (TRACE_EXECUTION(), instruction = READ_BYTE())
+#define CASE(op) case op
+#define DISPATCH() continue
+#endif
+
+    LOAD_FRAME();
+
+    uint8_t instruction;
+    INTERPRET_LOOP
+    {
+        CASE(OP_CONSTANT): {
             Value constant = READ_CONSTANT();
-            push(constant);
-            break;
-        }
-        case OP_NONE:
-            push(NONE_VAL);
-            break;
-        case OP_TRUE:
-            push(BOOL_VAL(true));
-            break;
-        case OP_FALSE:
-            push(BOOL_VAL(false));
-            break;
-        case OP_POP:
-            pop();
-            break;
-        case OP_GET_LOCAL: {
+            PUSH(constant);
+            DISPATCH();
+        }
+        CASE(OP_NONE):
+            PUSH(NONE_VAL);
+            DISPATCH();
+        CASE(OP_TRUE):
+            PUSH(BOOL_VAL(true));
+            DISPATCH();
+        CASE(OP_FALSE):
+            PUSH(BOOL_VAL(false));
+            DISPATCH();
+        CASE(OP_POP):
+            DROP();
+            DISPATCH();
+        CASE(OP_GET_LOCAL): {
             uint8_t slot = READ_BYTE();
-            push(frame->slots[slot]);
-            break;
+            PUSH(slots[slot]);
+            DISPATCH();
         }
-        case OP_SET_LOCAL: {
+        CASE(OP_SET_LOCAL): {
             uint8_t slot = READ_BYTE();
-            frame->slots[slot] = peek(0);
-            break;
+            slots[slot] = PEEK(0);
+            DISPATCH();
         }
-        case OP_GET_GLOBAL: {
-            ObjString *name = READ_STRING();
-            Value value;
-            if (!tableGet(&vm.globals, name, &value))
+        CASE(OP_GET_GLOBAL): {
+            uint8_t slot = READ_BYTE();
+            Value value = vm.globalValues.values[slot];
+            if (IS_UNDEFINED(value))
             {
-                runtimeError("Undefined variable '%s'.", name->chars);
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Undefined variable '%s'.", AS_CSTRING(vm.globalNames.values[slot]));
             }
-            push(value);
-            break;
-        }
-        case OP_DEFINE_GLOBAL: {
-            ObjString *name = READ_STRING();
-            tableSet(&vm.globals, name, peek(0));
-            pop();
-            break;
-        }
-        case OP_SET_GLOBAL: {
-            ObjString *name = READ_STRING();
-            if (tableSet(&vm.globals, name, peek(0)))
+            PUSH(value);
+            DISPATCH();
+        }
+        CASE(OP_DEFINE_GLOBAL): {
+            uint8_t slot = READ_BYTE();
+            vm.globalValues.values[slot] = PEEK(0);
+            DROP();
+            DISPATCH();
+        }
+        CASE(OP_SET_GLOBAL): {
+            uint8_t slot = READ_BYTE();
+            if (IS_UNDEFINED(vm.globalValues.values[slot]))
             {
-                tableDelete(&vm.globals, name);
-                runtimeError("Undefined variable '%s'.", name->chars);
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Undefined variable '%s'.", AS_CSTRING(vm.globalNames.values[slot]));
             }
-            break;
+            vm.globalValues.values[slot] = PEEK(0);
+            DISPATCH();
         }
-        case OP_BUILD_LIST: {
+        CASE(OP_BUILD_LIST_LONG):
+        CASE(OP_BUILD_LIST): {
             // Stack before: [item1, item2, ..., itemN] and after: [list]
+            int itemCount = ip[-1] == OP_BUILD_LIST ? READ_BYTE() : READ_LONG();
+            STORE_FRAME();
             ObjList *list = newList();
-            uint8_t itemCount = READ_BYTE();
 
             // Add items to list
-            push(OBJ_VAL(list)); // So list isn't sweeped by GC in appendToList
+            PUSH(OBJ_VAL(list)); // So list isn't sweeped by GC in appendToList
+            STORE_FRAME();
             for (int i = itemCount; i > 0; i--)
             {
-                appendToList(list, peek(i));
+                appendToList(list, PEEK(i));
             }
-            pop();
+            DROP();
 
             // Pop items from stack
             while (itemCount-- > 0)
             {
-                pop();
+                DROP();
             }
 
-            push(OBJ_VAL(list));
-            break;
+            PUSH(OBJ_VAL(list));
+            DISPATCH();
         }
-        case OP_INDEX_SUBSCR: {
-            // Stack before: [list, index] and after: [index(list, index)]
-            Value v_index = pop();
-            Value collection = pop();
-            Value result;
-
-            if (!IS_LIST(collection) && !IS_STRING(collection))
+        CASE(OP_BUILD_DICT_LONG):
+        CASE(OP_BUILD_DICT): {
+            // Stack before: [key1, value1, ..., keyN, valueN] and after: [dict]
+            int entryCount = ip[-1] == OP_BUILD_DICT ? READ_BYTE() : READ_LONG();
+            for (int i = entryCount; i > 0; i--)
             {
-                runtimeError("Invalid type to index into.");
-                return INTERPRET_RUNTIME_ERROR;
+                if (!isHashable(PEEK(2 * i - 1)))
+                    RUNTIME_ERROR("Lists, builders, dicts and bitsets cannot be dict keys.");
             }
 
-            if (!IS_NUMBER(v_index))
+            STORE_FRAME();
+            ObjDict *dict = newDict();
+            PUSH(OBJ_VAL(dict));
+            STORE_FRAME();
+            reserveDict(dict, entryCount);
+            for (int i = entryCount; i > 0; i--)
             {
-                runtimeError("Index is not a number.");
-                return INTERPRET_RUNTIME_ERROR;
+                dictSet(dict, PEEK(2 * i), PEEK(2 * i - 1));
             }
+            DROP();
 
-            int index = AS_NUMBER(v_index);
-
-            if (IS_STRING(collection))
-            {
-                ObjString *str = AS_STRING(collection);
+            sp -= 2 * entryCount;
+            PUSH(OBJ_VAL(dict));
+            DISPATCH();
+        }
+        CASE(OP_INDEX_SUBSCR): {
+            // Stack before: [list, index] and after: [index(list, index)]
+            Value index = POP();
+            Value collection = POP();
+            Value result;
 
-                if (!isValidStringIndex(str, index))
-                {
-                    runtimeError("String index out of range.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
+            STORE_FRAME();
+            if (!indexValue(collection, index, &result))
+                return INTERPRET_RUNTIME_ERROR;
 
-                result = indexFromString(str, AS_NUMBER(v_index));
-            }
-            else
-            {
-                ObjList *list = AS_LIST(collection);
+            if (IS_LIST(collection) && IS_INT(index))
+                QUICKEN(OP_INDEX_LIST_INT);
+            else if (IS_BITSET(collection) && IS_INT(index))
+                QUICKEN(OP_INDEX_BITSET_INT);
 
-                if (!isValidListIndex(list, index))
-                {
-                    runtimeError("List index out of range.");
-                    return INTERPRET_RUNTIME_ERROR;
-                }
+            PUSH(result);
+            DISPATCH();
+        }
+        CASE(OP_SLICE): {
+            // Stack before: [collection, start, end] and after: [collection[start:end]]
+            Value result;
 
-                result = indexFromList(list, AS_NUMBER(v_index));
-            }
+            STORE_FRAME();
+            if (!sliceValue(PEEK(2), PEEK(1), PEEK(0), &result))
+                return INTERPRET_RUNTIME_ERROR;
 
-            push(result);
-            break;
+            sp -= 2;
+            PEEK(0) = result;
+            DISPATCH();
         }
-        case OP_STORE_SUBSCR: {
+        CASE(OP_STORE_SUBSCR): {
             // Stack before: [list, index, item] and after: [item]
-            Value item = pop();
-            Value v_index = pop();
-            Value v_list = pop();
+            if (IS_DICT(PEEK(2)))
+            {
+                if (!isHashable(PEEK(1)))
+                    RUNTIME_ERROR("Lists, builders, dicts and bitsets cannot be dict keys.");
+
+                // The operands stay on the stack while the dict may grow.
+                STORE_FRAME();
+                dictSet(AS_DICT(PEEK(2)), PEEK(1), PEEK(0));
+                Value item = POP();
+                sp -= 2;
+                PUSH(item);
+                DISPATCH();
+            }
+
+            if (IS_BITSET(PEEK(2)))
+            {
+                ObjBitset *bitset = AS_BITSET(PEEK(2));
+                if (!IS_NUMBER(PEEK(1)))
+                    RUNTIME_ERROR("Bitset index is not a number.");
+
+                int64_t index = IS_INT(PEEK(1)) ? AS_INT(PEEK(1)) : (int64_t)AS_DOUBLE(PEEK(1));
+                if (index < -bitset->length || index >= bitset->length)
+                    RUNTIME_ERROR("Bitset index out of range.");
+
+                if (IS_INT(PEEK(1)))
+                    QUICKEN(OP_STORE_BITSET_INT);
+
+                Value item = POP();
+                sp -= 2;
+                bitsetSet(bitset, (index < 0) * bitset->length + index, !isFalsey(item));
+                PUSH(item);
+                DISPATCH();
+            }
+
+            Value item = POP();
+            Value v_index = POP();
+            Value v_list = POP();
 
             if (!IS_LIST(v_list))
             {
-                runtimeError("Cannot store value in a non-list.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Cannot store value in a non-list.");
             }
 
             ObjList *list = AS_LIST(v_list);
 
             if (!IS_NUMBER(v_index))
             {
-                runtimeError("List index is not a number.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("List index is not a number.");
             }
 
-            int index = AS_NUMBER(v_index);
+            int64_t index = IS_INT(v_index) ? AS_INT(v_index) : (int64_t)AS_DOUBLE(v_index);
 
             if (!isValidListIndex(list, index))
             {
-                runtimeError("Invalid list index.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Invalid list index.");
             }
 
             storeToList(list, index, item);
-            push(item);
-            break;
-        }
-        case OP_EQUAL: {
-            Value b = pop();
-            Value a = pop();
-            push(BOOL_VAL(valuesEqual(a, b)));
-            break;
-        }
-        case OP_GREATER:
-            BINARY_OP(BOOL_VAL, >);
-            break;
-        case OP_LESS:
-            BINARY_OP(BOOL_VAL, <);
-            break;
-        case OP_ADD: {
-            if (IS_STRING(peek(0)) && IS_STRING(peek(1)))
-            {
-                concatenate();
-            }
-            else if (IS_LIST(peek(0)) && IS_LIST(peek(1)))
-            {
-                concat_list();
-            }
-            else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
+            if (IS_INT(v_index))
+                QUICKEN(OP_STORE_LIST_INT);
+            PUSH(item);
+            DISPATCH();
+        }
+        CASE(OP_EQUAL): {
+            Value b = POP();
+            Value a = POP();
+            PUSH(BOOL_VAL(valuesEqual(a, b)));
+            DISPATCH();
+        }
+        CASE(OP_GREATER):
+            COMPARE_OP(>);
+            DISPATCH();
+        CASE(OP_LESS):
+            COMPARE_OP(<);
+            DISPATCH();
+        CASE(OP_IN): {
+            // Stack before: [item, container] and after: [item in container]
+            bool found;
+            STORE_FRAME();
+            if (!containsValue(PEEK(0), PEEK(1), &found))
+                return INTERPRET_RUNTIME_ERROR;
+
+            DROP();
+            PEEK(0) = BOOL_VAL(found);
+            DISPATCH();
+        }
+        CASE(OP_ADD): {
+            if (IS_NUMBER(PEEK(0)) && IS_NUMBER(PEEK(1)))
             {
-                double b = AS_NUMBER(pop());
-                double a = AS_NUMBER(pop());
-                push(NUMBER_VAL(a + b));
+                if (IS_INT(PEEK(0)) && IS_INT(PEEK(1)))
+                    QUICKEN(OP_ADD_INT);
+                else if (IS_DOUBLE(PEEK(0)) && IS_DOUBLE(PEEK(1)))
+                    QUICKEN(OP_ADD_DOUBLE);
+
+                Value b = POP();
+                PEEK(0) = addNumbers(PEEK(0), b);
             }
             else
             {
-                runtimeError("Operands must be two numbers or two strings or two list.");
-                return INTERPRET_RUNTIME_ERROR;
+                STORE_FRAME();
+                if (!concatenateValues())
+                    return INTERPRET_RUNTIME_ERROR;
+                sp = vm.stackTop;
             }
-            break;
+            DISPATCH();
         }
-        case OP_SUBTRACT:
-            BINARY_OP(NUMBER_VAL, -);
-            break;
-        case OP_MULTIPLY: {
-            if (IS_STRING(peek(0)) && IS_NUMBER(peek(1)) || IS_NUMBER(peek(0)) && IS_STRING(peek(1)))
+        CASE(OP_SUBTRACT):
+            BINARY_OP(subtractNumbers);
+            DISPATCH();
+        CASE(OP_MULTIPLY): {
+            if (IS_STRING(PEEK(0)) && IS_NUMBER(PEEK(1)) || IS_NUMBER(PEEK(0)) && IS_STRING(PEEK(1)))
             {
+                STORE_FRAME();
                 if (!scaler_str_mul())
                     return INTERPRET_RUNTIME_ERROR;
+                sp = vm.stackTop;
             }
-            else if (IS_LIST(peek(0)) && IS_NUMBER(peek(1)) || IS_NUMBER(peek(0)) && IS_LIST(peek(1)))
+            else if (IS_LIST(PEEK(0)) && IS_NUMBER(PEEK(1)) || IS_NUMBER(PEEK(0)) && IS_LIST(PEEK(1)))
             {
+                STORE_FRAME();
                 if (!scaler_list_mul())
                     return INTERPRET_RUNTIME_ERROR;
+                sp = vm.stackTop;
             }
-            else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
+            else if (IS_NUMBER(PEEK(0)) && IS_NUMBER(PEEK(1)))
             {
-                double b = AS_NUMBER(pop());
-                double a = AS_NUMBER(pop());
-                push(NUMBER_VAL(a * b));
+                if (IS_INT(PEEK(0)) && IS_INT(PEEK(1)))
+                    QUICKEN(OP_MULTIPLY_INT);
+                else if (IS_DOUBLE(PEEK(0)) && IS_DOUBLE(PEEK(1)))
+                    QUICKEN(OP_MULTIPLY_DOUBLE);
+
+                Value b = POP();
+                PEEK(0) = multiplyNumbers(PEEK(0), b);
             }
-            break;
+            DISPATCH();
         }
-        case OP_DIVIDE:
-            BINARY_OP(NUMBER_VAL, /);
-            break;
-        case OP_INTDIV: {
-            if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))
+        CASE(OP_DIVIDE):
+            BINARY_OP(divideNumbers);
+            DISPATCH();
+        CASE(OP_INTDIV):
+            BINARY_OP(floorDivideNumbers);
+            DISPATCH();
+        CASE(OP_MOD):
+            BINARY_OP(moduloNumbers);
+            DISPATCH();
+        CASE(OP_POW):
+            BINARY_OP(powerNumbers);
+            DISPATCH();
+        CASE(OP_NOT):
+            PEEK(0) = BOOL_VAL(isFalsey(PEEK(0)));
+            DISPATCH();
+        CASE(OP_NEGATE):
+            if (!IS_NUMBER(PEEK(0)))
             {
-                runtimeError("Operands must be numbers.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Operand must be a number.");
             }
-            double b = AS_NUMBER(pop());
-            double a = AS_NUMBER(pop());
-            push(NUMBER_VAL(floor(a / b)));
-            break;
-        }
-        case OP_MOD: {
-            if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))
+            if (IS_INT(PEEK(0)))
+                PEEK(0) = subtractNumbers(INT_VAL(0), PEEK(0));
+            else
+                PEEK(0) = NUMBER_VAL(-AS_DOUBLE(PEEK(0)));
+            DISPATCH();
+        CASE(OP_BAND):
+            if (IS_BITSET(PEEK(0)) || IS_BITSET(PEEK(1)))
+                BITSET_OP(BITSET_AND);
+            else
+                BITWISE_OP(intOrDouble(a & b));
+            DISPATCH();
+        CASE(OP_BOR):
+            if (IS_BITSET(PEEK(0)) || IS_BITSET(PEEK(1)))
+                BITSET_OP(BITSET_OR);
+            else
+                BITWISE_OP(intOrDouble(a | b));
+            DISPATCH();
+        CASE(OP_XOR):
+            if (IS_BITSET(PEEK(0)) || IS_BITSET(PEEK(1)))
+                BITSET_OP(BITSET_XOR);
+            else
+                BITWISE_OP(intOrDouble(a ^ b));
+            DISPATCH();
+        CASE(OP_BNOT): {
+            if (!IS_NUMBER(PEEK(0)))
             {
-                runtimeError("Operands must be numbers.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Operand must be a number.");
             }
-            double b = AS_NUMBER(pop());
-            double a = AS_NUMBER(pop());
-            push(NUMBER_VAL(mod(a, b)));
-            break;
+
+            int64_t num;
+            if (!toInteger(PEEK(0), &num))
+            {
+                RUNTIME_ERROR("Number must be of integer type.");
+            }
+
+            PEEK(0) = intOrDouble(~num);
+            DISPATCH();
         }
-        case OP_POW: {
-            if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1)))
+        CASE(OP_LSHIFT):
+            if (IS_NUMBER(PEEK(0)) && AS_NUMBER(PEEK(0)) < 0)
             {
-                runtimeError("Operands must be numbers.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Negative shift count.");
             }
-            double b = AS_NUMBER(pop());
-            double a = AS_NUMBER(pop());
-            push(NUMBER_VAL(pow(a, b)));
-            break;
-        }
-        case OP_NOT:
-            push(BOOL_VAL(isFalsey(pop())));
-            break;
-        case OP_NEGATE:
-            if (!IS_NUMBER(peek(0)))
+            BITWISE_OP(shiftLeft(a, b));
+            DISPATCH();
+        CASE(OP_RSHIFT):
+            if (IS_NUMBER(PEEK(0)) && AS_NUMBER(PEEK(0)) < 0)
             {
-                runtimeError("Operand must be a number.");
-                return INTERPRET_RUNTIME_ERROR;
+                RUNTIME_ERROR("Negative shift count.");
             }
-            push(NUMBER_VAL(-AS_NUMBER(pop())));
-            break;
-        case OP_BAND:
-            BITWISE_OP(NUMBER_VAL, &);
-            break;
-        case OP_BOR:
-            BITWISE_OP(NUMBER_VAL, |);
-            break;
-        case OP_XOR:
-            BITWISE_OP(NUMBER_VAL, ^);
-            break;
-        case OP_BNOT:
-            if (!IS_NUMBER(peek(0)))
+            BITWISE_OP(shiftRight(a, b));
+            DISPATCH();
+        CASE(OP_JUMP): {
+            uint16_t offset = READ_SHORT();
+            ip += offset;
+            DISPATCH();
+        }
+        CASE(OP_JUMP_IF_FALSE): {
+            uint16_t offset = READ_SHORT();
+            if (isFalsey(PEEK(0)))
+                ip += offset;
+            DISPATCH();
+        }
+        CASE(OP_LOOP): {
+            uint16_t offset = READ_SHORT();
+            ip -= offset;
+            DISPATCH();
+        }
+        CASE(OP_CALL): {
+            int argCount = READ_BYTE();
+            STORE_FRAME();
+            if (!callValue(PEEK(argCount), argCount))
             {
-                runtimeError("Operand must be a number.");
                 return INTERPRET_RUNTIME_ERROR;
             }
+            LOAD_FRAME();
+            DISPATCH();
+        }
+        CASE(OP_TAIL_CALL): {
+            int argCount = READ_BYTE();
+            Value callee = PEEK(argCount);
+            STORE_FRAME();
 
-            double num = AS_NUMBER(pop());
+            // Natives and calls that will fail take the ordinary path, the
+            // OP_RETURN that follows hands their result back.
+            if (!IS_FUNCTION(callee) || AS_FUNCTION(callee)->arity != argCount)
+            {
+                if (!callValue(callee, argCount))
+                    return INTERPRET_RUNTIME_ERROR;
+                LOAD_FRAME();
+                DISPATCH();
+            }
 
-            if (!isInt(num))
+            // Slide the callee and its arguments down over the current frame
+            // and start the callee in its place.
+            memmove(slots, sp - argCount - 1, sizeof(Value) * (argCount + 1));
+            vm.stackTop = slots + argCount + 1;
+            vm.frameCount--;
+            call(AS_FUNCTION(callee), argCount);
+            LOAD_FRAME();
+            DISPATCH();
+        }
+        CASE(OP_RETURN): {
+            Value result = POP();
+            vm.frameCount--;
+            if (vm.frameCount == 0)
             {
-                runtimeError("Number must be of integer type.");
-                return INTERPRET_RUNTIME_ERROR;
+                vm.stackTop = slots;
+                return INTERPRET_OK;
             }
 
-            push(NUMBER_VAL(~(int)num));
-            break;
-            break;
-        case OP_LSHIFT:
-            BITWISE_OP(NUMBER_VAL, >>);
-            break;
-        case OP_RSHIFT:
-            BITWISE_OP(NUMBER_VAL, <<);
-            break;
-        case OP_JUMP: {
-            uint16_t offset = READ_SHORT();
-            frame->ip += offset;
-            break;
+            slots[0] = result;
+            vm.stackTop = slots + 1;
+            LOAD_FRAME();
+            DISPATCH();
+        }
+        CASE(OP_CONSTANT_LONG): {
+            Value constant = constants[READ_LONG()];
+            PUSH(constant);
+            DISPATCH();
+        }
+        CASE(OP_GET_LOCAL_LONG): {
+            int slot = READ_LONG();
+            PUSH(slots[slot]);
+            DISPATCH();
+        }
+        CASE(OP_SET_LOCAL_LONG): {
+            int slot = READ_LONG();
+            slots[slot] = PEEK(0);
+            DISPATCH();
         }
-        case OP_JUMP_IF_FALSE: {
+        CASE(OP_GET_GLOBAL_LONG): {
+            int slot = READ_LONG();
+            Value value = vm.globalValues.values[slot];
+            if (IS_UNDEFINED(value))
+            {
+                RUNTIME_ERROR("Undefined variable '%s'.", AS_CSTRING(vm.globalNames.values[slot]));
+            }
+            PUSH(value);
+            DISPATCH();
+        }
+        CASE(OP_DEFINE_GLOBAL_LONG): {
+            int slot = READ_LONG();
+            vm.globalValues.values[slot] = PEEK(0);
+            DROP();
+            DISPATCH();
+        }
+        CASE(OP_SET_GLOBAL_LONG): {
+            int slot = READ_LONG();
+            if (IS_UNDEFINED(vm.globalValues.values[slot]))
+            {
+                RUNTIME_ERROR("Undefined variable '%s'.", AS_CSTRING(vm.globalNames.values[slot]));
+            }
+            vm.globalValues.values[slot] = PEEK(0);
+            DISPATCH();
+        }
+        CASE(OP_JUMP_IF_NOT_EQUAL): {
             uint16_t offset = READ_SHORT();
-            if (isFalsey(peek(0)))
-                frame->ip += offset;
-            break;
+            Value b = POP();
+            Value a = POP();
+            if (!valuesEqual(a, b))
+                ip += offset;
+            DISPATCH();
         }
-        case OP_LOOP: {
+        CASE(OP_JUMP_IF_EQUAL): {
             uint16_t offset = READ_SHORT();
-            frame->ip -= offset;
-            break;
+            Value b = POP();
+            Value a = POP();
+            if (valuesEqual(a, b))
+                ip += offset;
+            DISPATCH();
         }
-        case OP_CALL: {
-            int argCount = READ_BYTE();
-            if (!callValue(peek(argCount), argCount))
+        CASE(OP_JUMP_IF_NOT_GREATER):
+            COMPARE_JUMP(>, false);
+            DISPATCH();
+        CASE(OP_JUMP_IF_GREATER):
+            COMPARE_JUMP(>, true);
+            DISPATCH();
+        CASE(OP_JUMP_IF_NOT_LESS):
+            COMPARE_JUMP(<, false);
+            DISPATCH();
+        CASE(OP_JUMP_IF_LESS):
+            COMPARE_JUMP(<, true);
+            DISPATCH();
+        CASE(OP_INCR_LOCAL): {
+            uint8_t slot = READ_BYTE();
+            Value value = slots[slot];
+            Value constant = READ_CONSTANT();
+            int64_t result;
+            if (BOTH_INTS(value, constant) && addInts(AS_INT(value), AS_INT(constant), &result))
             {
-                return INTERPRET_RUNTIME_ERROR;
+                slots[slot] = INT_VAL(result);
+                DISPATCH();
+            }
+
+            if (!IS_NUMBER(value))
+            {
+                RUNTIME_ERROR("Operands must be two numbers or two strings or two list.");
             }
-            frame = &vm.frames[vm.frameCount - 1];
-            break;
+            slots[slot] = addNumbers(value, constant);
+            DISPATCH();
         }
-        case OP_RETURN: {
-            Value result = pop();
-            vm.frameCount--;
-            if (vm.frameCount == 0)
+        CASE(OP_ADD_LOCALS): {
+            Value a = slots[READ_BYTE()];
+            Value b = slots[READ_BYTE()];
+            if (BOTH_INTS(a, b) || BOTH_DOUBLES(a, b) || (IS_NUMBER(a) && IS_NUMBER(b)))
             {
-                pop();
-                return INTERPRET_OK;
+                PUSH(addNumbers(a, b));
+                DISPATCH();
             }
 
-            vm.stackTop = frame->slots;
-            push(result);
-            frame = &vm.frames[vm.frameCount - 1];
-            break;
+            PUSH(a);
+            PUSH(b);
+            STORE_FRAME();
+            if (!concatenateValues())
+                return INTERPRET_RUNTIME_ERROR;
+            sp = vm.stackTop;
+            DISPATCH();
+        }
+        CASE(OP_INDEX_SUBSCR2): {
+            // Stack before: [list, i, j] and after: [index(index(list, i), j)]
+            Value inner = POP();
+            Value outer = POP();
+            Value collection = POP();
+            Value row, result;
+
+            STORE_FRAME();
+            if (!indexValue(collection, outer, &row) || !indexValue(row, inner, &result))
+                return INTERPRET_RUNTIME_ERROR;
+
+            if (IS_LIST(collection) && IS_LIST(row) && IS_INT(outer) && IS_INT(inner))
+                QUICKEN(OP_INDEX2_LIST_INT);
+
+            PUSH(result);
+            DISPATCH();
+        }
+        CASE(OP_ADD_INT): {
+            int64_t result;
+            if (!IS_INT(PEEK(0)) || !IS_INT(PEEK(1)) || !addInts(AS_INT(PEEK(1)), AS_INT(PEEK(0)), &result))
+                DEOPTIMIZE(OP_ADD);
+
+            DROP();
+            PEEK(0) = INT_VAL(result);
+            DISPATCH();
+        }
+        CASE(OP_ADD_DOUBLE): {
+            if (!IS_DOUBLE(PEEK(0)) || !IS_DOUBLE(PEEK(1)))
+                DEOPTIMIZE(OP_ADD);
+
+            double b = AS_DOUBLE(POP());
+            PEEK(0) = NUMBER_VAL(AS_DOUBLE(PEEK(0)) + b);
+            DISPATCH();
+        }
+        CASE(OP_MULTIPLY_INT): {
+            int64_t result;
+            if (!IS_INT(PEEK(0)) || !IS_INT(PEEK(1)) || !multiplyInts(AS_INT(PEEK(1)), AS_INT(PEEK(0)), &result))
+                DEOPTIMIZE(OP_MULTIPLY);
+
+            DROP();
+            PEEK(0) = INT_VAL(result);
+            DISPATCH();
+        }
+        CASE(OP_MULTIPLY_DOUBLE): {
+            if (!IS_DOUBLE(PEEK(0)) || !IS_DOUBLE(PEEK(1)))
+                DEOPTIMIZE(OP_MULTIPLY);
+
+            double b = AS_DOUBLE(POP());
+            PEEK(0) = NUMBER_VAL(AS_DOUBLE(PEEK(0)) * b);
+            DISPATCH();
+        }
+        CASE(OP_INDEX_LIST_INT): {
+            if (!IS_LIST(PEEK(1)) || !IS_INT(PEEK(0)))
+                DEOPTIMIZE(OP_INDEX_SUBSCR);
+
+            ObjList *list = AS_LIST(PEEK(1));
+            int64_t index = AS_INT(PEEK(0));
+            if (!isValidListIndex(list, index))
+                DEOPTIMIZE(OP_INDEX_SUBSCR);
+
+            DROP();
+            PEEK(0) = indexFromList(list, index);
+            DISPATCH();
+        }
+        CASE(OP_INDEX2_LIST_INT): {
+            if (!IS_LIST(PEEK(2)) || !IS_INT(PEEK(1)) || !IS_INT(PEEK(0)))
+                DEOPTIMIZE(OP_INDEX_SUBSCR2);
+
+            ObjList *outer = AS_LIST(PEEK(2));
+            int64_t i = AS_INT(PEEK(1));
+            if (!isValidListIndex(outer, i) || !IS_LIST(indexFromList(outer, i)))
+                DEOPTIMIZE(OP_INDEX_SUBSCR2);
+
+            ObjList *inner = AS_LIST(indexFromList(outer, i));
+            int64_t j = AS_INT(PEEK(0));
+            if (!isValidListIndex(inner, j))
+                DEOPTIMIZE(OP_INDEX_SUBSCR2);
+
+            sp -= 2;
+            PEEK(0) = indexFromList(inner, j);
+            DISPATCH();
+        }
+        CASE(OP_STORE_LIST_INT): {
+            if (!IS_LIST(PEEK(2)) || !IS_INT(PEEK(1)))
+                DEOPTIMIZE(OP_STORE_SUBSCR);
+
+            ObjList *list = AS_LIST(PEEK(2));
+            int64_t index = AS_INT(PEEK(1));
+            if (!isValidListIndex(list, index))
+                DEOPTIMIZE(OP_STORE_SUBSCR);
+
+            Value item = POP();
+            sp -= 2;
+            storeToList(list, index, item);
+            PUSH(item);
+            DISPATCH();
+        }
+        CASE(OP_INDEX_BITSET_INT): {
+            if (!IS_BITSET(PEEK(1)) || !IS_INT(PEEK(0)))
+                DEOPTIMIZE(OP_INDEX_SUBSCR);
+
+            ObjBitset *bitset = AS_BITSET(PEEK(1));
+            int64_t index = AS_INT(PEEK(0));
+            if (index < -bitset->length || index >= bitset->length)
+                DEOPTIMIZE(OP_INDEX_SUBSCR);
+
+            DROP();
+            PEEK(0) = BOOL_VAL(bitsetGet(bitset, (index < 0) * bitset->length + index));
+            DISPATCH();
         }
+        CASE(OP_STORE_BITSET_INT): {
+            if (!IS_BITSET(PEEK(2)) || !IS_INT(PEEK(1)))
+                DEOPTIMIZE(OP_STORE_SUBSCR);
+
+            ObjBitset *bitset = AS_BITSET(PEEK(2));
+            int64_t index = AS_INT(PEEK(1));
+            if (index < -bitset->length || index >= bitset->length)
+                DEOPTIMIZE(OP_STORE_SUBSCR);
+
+            Value item = POP();
+            sp -= 2;
+            bitsetSet(bitset, (index < 0) * bitset->length + index, !isFalsey(item));
+            PUSH(item);
+            DISPATCH();
         }
     }
 
+#undef LOAD_FRAME
+#undef STORE_FRAME
+#undef RUNTIME_ERROR
+#undef PUSH
+#undef POP
+#undef DROP
+#undef PEEK
 #undef READ_BYTE
 #undef READ_SHORT
+#undef READ_LONG
 #undef READ_CONSTANT
 #undef READ_STRING
+#undef QUICKEN
+#undef DEOPTIMIZE
 #undef BINARY_OP
+#undef COMPARE_OP
+#undef BITWISE_OP
+#undef BITSET_OP
+#undef COMPARE_JUMP
+#undef TRACE_EXECUTION
+#undef INTERPRET_LOOP
+#undef CASE
+#undef DISPATCH
 }
 
 InterpretResult interpret(const char *source)
@@ -5,8 +5,14 @@
 #include "table.h"
 #include "value.h"
 
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+// The call frames and the value stack start small and grow on demand; this
+// caps the call depth. Override with -DFRAMES_MAX=<n>.
+#ifndef FRAMES_MAX
+#define FRAMES_MAX 65536
+#endif
+
+#define FRAMES_INITIAL 64
+#define STACK_INITIAL 256
 
 typedef struct
 {
@@ -15,16 +21,48 @@ typedef struct
     Value *slots;
 } CallFrame;
 
+typedef enum
+{
+    GC_IDLE,
+    GC_MARK,
+    GC_SWEEP
+} GCPhase;
+
 typedef struct
 {
-    CallFrame frames[FRAMES_MAX];
+    int count;
+    int capacity;
+    Obj **objects;
+} ObjStack;
+
+typedef struct
+{
+    CallFrame *frames;
     int frameCount;
+    int frameCapacity;
 
-    Value stack[STACK_MAX];
+    Value *stack;
     Value *stackTop;
-    Table globals;
+    int stackCapacity;
+    Table globalSlots;
+    ValueArray globalNames;
+    ValueArray globalValues;
     Table strings;
+    ObjString *charStrings[UINT8_COUNT];
+    ObjString *tinyStrings[TINY_CACHE_SIZE];
+
+    size_t bytesAllocated;
+    size_t nextGC;
+    size_t nurseryLimit;
     Obj *objects;
+    Obj *oldObjects;
+    Obj *sweepObjects;
+    GCPhase gcPhase;
+    bool collectingYoung;
+    ObjStack youngGray;
+    ObjStack oldGray;
+    ObjStack remembered;
+    ObjStack views; // Old string views whose parent was alive when last checked.
 } VM;
 
 typedef enum
@@ -39,6 +77,7 @@ extern VM vm;
 void initVM();
 void freeVM();
 InterpretResult interpret(const char *source);
+int globalSlot(ObjString *name);
 void push(Value value);
 Value pop();
 
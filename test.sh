@@ -1,16 +1,31 @@
 #!/usr/bin/env bash
 
-DIR="test"
+# Runs every test program and compares what it prints, errors included, with
+# the .out file next to it. Set BIN to test another binary, e.g. the one
+# `make stress` builds.
+
+DIR="${DIR:-test}"
+BIN="${BIN:-./build/release/purr}"
 
 RED='\033[0;31m'
 BLUE='\033[34m'
 NC='\033[0m' # No Color
 
+failed=0
+
 for file in "$DIR"/*.prr; do
+    expected="${file%.prr}.out"
+    actual=$(echo "purr" | "$BIN" "$file" 2>&1)
 
-    if ! ./build/release/purr "$file"; then
-        echo -e "${RED}Error occurred while running $file${NC}"
+    if [ ! -f "$expected" ]; then
+        echo -e "${RED}No expected output for $file${NC}"
+        failed=1
+    elif ! diff -u "$expected" - <<< "$actual"; then
+        echo -e "${RED}Unexpected output from $file${NC}"
+        failed=1
+    else
+        echo -e "${BLUE}ok${NC} $file"
     fi
-
-    echo -e "${BLUE}\n\n--- end ---\n${NC}"
 done
+
+exit $failed